@@ -5,17 +5,37 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
+#include "aggregation.h"
+#include "checkpoint.h"
+#include "memory.h"
+#include "metrics.h"
+#include "pathOracle.h"
+#include "promiscuous.h"
 
 using namespace omnetpp;
 
-class BidirectionalLeafNode : public cSimpleModule {
+class BidirectionalLeafNode : public cSimpleModule, public Checkpointable, public MetricsSource, public MemoryAccountable {
 private:
     std::map<std::string, std::vector<std::string>> routingTable; // Routing table: destination -> route
     std::set<std::string> knownMessages;                         // Avoid processing duplicate RREQs
+    std::map<std::string, std::vector<std::vector<std::string>>> repliedPaths; // RREQ paths answered as destination, per request
     int routingMsgCount = 0;                                     // Count of routing messages processed
+    int packetsDelivered = 0;                                    // Data messages received as destination
+    simsignal_t deliveredSignal;                                 // packetDelivered, counted by the source
+    PathOracle *oracle = nullptr;                                // Scores delivery paths, if the network has one
+    cMessage *checkpointEvent = nullptr;                         // Coordinator only: time to write the checkpoint
+
+    int maxRoutes = 1;                                           // Maximum number of disjoint RREQ paths answered
+    bool linkDisjoint = false;                                   // Link-disjoint instead of node-disjoint paths
+
+    bool harvestRoutes = false;                                  // Learn routes from the paths of RREQs, RREPs and data reaching this node
+    bool promiscuous = false;                                    // Also learn from paths overheard from the neighbor
+    int routeDiscoveries = 0;                                    // RREQ floods started by this node
+    int routesLearned = 0;                                       // Routes cached by harvesting or overhearing
 
 protected:
-    virtual void initialize() override;
+    virtual int numInitStages() const override { return 2; }
+    virtual void initialize(int stage) override;
     virtual void handleMessage(cMessage *msg) override;
     virtual void finish() override;
 
@@ -30,15 +50,68 @@ protected:
     // Helper functions
     int findGateToNode(const std::string &nodeName);
     std::vector<std::string> parsePath(const std::string &path);
+    bool isDisjoint(const std::vector<std::string> &a, const std::vector<std::string> &b);
+    bool cacheRoute(const std::string &destination, const std::vector<std::string> &route);
+    void learnRoutes(const std::vector<std::string> &path, int at, const std::vector<std::string> &prefix);
+    void overhear(const std::string &sender, const std::vector<std::string> &path);
+
+public:
+    virtual ~BidirectionalLeafNode();
+
+    // Checkpointable
+    virtual void saveState(std::ostream &out) const override;
+    virtual void loadState(std::istream &in) override;
+
+    virtual void sampleMetrics(std::map<std::string, double> &metrics) const override;
+    virtual void reportMemory(std::map<std::string, size_t> &bytes) const override;
 };
 
 Define_Module(BidirectionalLeafNode);
 
-void BidirectionalLeafNode::initialize() {
+BidirectionalLeafNode::~BidirectionalLeafNode() {
+    cancelAndDelete(checkpointEvent);
+}
+
+void BidirectionalLeafNode::initialize(int stage) {
+    if (stage == 1) {
+        // Restore warm state and schedule the checkpoint on behalf of the network
+        cModule *network = getParentModule();
+        if (checkpoint::isCoordinator(this)) {
+            std::string restoreFile = network->par("restoreFile").stdstringValue();
+            if (!restoreFile.empty()) {
+                checkpoint::restore(network, restoreFile);
+            }
+            simtime_t checkpointTime = network->par("checkpointTime").doubleValue();
+            if (!network->par("checkpointFile").stdstringValue().empty() && checkpointTime >= 0) {
+                checkpointEvent = new cMessage("Checkpoint");
+                scheduleAt(checkpointTime, checkpointEvent);
+            }
+        }
+        return;
+    }
+
     routingMsgCount = 0;
+    deliveredSignal = registerSignal("packetDelivered");
+    oracle = PathOracle::find(this);
+
+    maxRoutes = par("maxRoutes");
+    linkDisjoint = std::string(par("disjointness").stringValue()) == "link";
+    harvestRoutes = par("harvestRoutes");
+    promiscuous = par("promiscuous");
 }
 
 void BidirectionalLeafNode::handleMessage(cMessage *msg) {
+    if (msg == checkpointEvent) {
+        checkpoint::save(getParentModule(), getParentModule()->par("checkpointFile").stdstringValue());
+        return;
+    }
+    if (aggregation::isBundle(msg)) {
+        for (cMessage *payload : aggregation::unbundle(msg)) {
+            handleMessage(payload);
+        }
+        return;
+    }
+
     int kind = msg->getKind();
 
     if (kind == 0) { // RREQ
@@ -47,6 +120,9 @@ void BidirectionalLeafNode::handleMessage(cMessage *msg) {
         handleRouteReply(msg);
     } else if (kind == 2) { // Data message
         handleDataMessage(msg);
+    } else if (kind == promiscuous::KIND) {
+        overhear(msg->par("sender").stringValue(), parsePath(msg->par("path").stringValue()));
+        delete msg;
     } else {
         EV << "Unknown message kind: " << kind << "\n";
         delete msg;
@@ -59,6 +135,7 @@ void BidirectionalLeafNode::sendRouteRequest(const std::string &destination) {
     rreq->addPar("source") = getName();
     rreq->addPar("destination") = destination.c_str();
     rreq->addPar("path") = getName();
+    rreq->addPar("id") = routeDiscoveries++; // A new discovery after a route error is not a duplicate
 
     // Broadcast the RREQ to all neighbors
     for (int i = 0; i < gateSize("io$o"); ++i) {
@@ -73,18 +150,36 @@ void BidirectionalLeafNode::handleRouteRequest(cMessage *rreq) {
     std::string destination = rreq->par("destination").stringValue();
     std::string path = rreq->par("path").stringValue();
 
-    std::string messageId = source + "->" + destination; // Unique message ID
-    if (knownMessages.find(messageId) != knownMessages.end()) {
+    std::string messageId = source + "->" + destination + "#" + std::to_string(rreq->par("id").intValue()); // Unique message ID
+
+    if (harvestRoutes) {
+        std::vector<std::string> reverse = parsePath(path + "-" + getName());
+        learnRoutes(reverse, reverse.size() - 1, std::vector<std::string>());
+    }
+
+    if (destination == getName()) {
+        // Reply to every RREQ copy whose path is disjoint from those already answered
+        std::vector<std::vector<std::string>> &replied = repliedPaths[messageId];
+        std::vector<std::string> route = parsePath(path + "-" + getName());
+        route.erase(route.begin()); // Compare from the first hop on, ending at this node
+
+        bool disjoint = (int)replied.size() < maxRoutes;
+        for (size_t i = 0; disjoint && i < replied.size(); ++i) {
+            disjoint = isDisjoint(replied[i], route);
+        }
+        if (disjoint) {
+            replied.push_back(route);
+            sendRouteReply(source, destination, path + "-" + getName());
+        }
         delete rreq;
         return;
     }
-    knownMessages.insert(messageId);
 
-    if (destination == getName()) {
-        sendRouteReply(source, destination, path + "-" + getName());
+    if (knownMessages.find(messageId) != knownMessages.end()) {
         delete rreq;
         return;
     }
+    knownMessages.insert(messageId);
 
     path += std::string("-") + getName();
     rreq->par("path") = path.c_str();
@@ -127,7 +222,10 @@ void BidirectionalLeafNode::handleRouteReply(cMessage *rrep) {
     }
 
     frontroute.assign(currentIt+1, route.end());
-    routingTable[source] = frontroute;
+    cacheRoute(source, frontroute);
+    if (harvestRoutes) {
+        learnRoutes(route, currentIt - route.begin(), std::vector<std::string>());
+    }
 
     backroute.assign(route.begin(), currentIt);
 
@@ -146,11 +244,29 @@ void BidirectionalLeafNode::handleRouteReply(cMessage *rrep) {
 void BidirectionalLeafNode::handleDataMessage(cMessage *msg) {
     std::string destination = msg->par("destination").stringValue();
 
+    // Data packets record the nodes they pass, for harvesting and loop detection
+    std::vector<std::string> path = parsePath(msg->par("path").stringValue());
+    if (std::find(path.begin(), path.end(), getName()) != path.end()) {
+        EV << "Dropping looping data packet at " << getName() << "\n";
+        delete msg;
+        return;
+    }
+    path.push_back(getName());
+    msg->par("path") = (std::string(msg->par("path").stringValue()) + "-" + getName()).c_str();
+    if (harvestRoutes) {
+        learnRoutes(path, path.size() - 1, std::vector<std::string>());
+    }
+
     simtime_t delay = simTime() - msg->getTimestamp();
 
     if (destination == getName()) {
         EV << "Message received at destination: " << msg->par("payload").stringValue() << "\n";
         EV << "End-to-end delay: " << delay << "\n";
+        packetsDelivered++;
+        emit(deliveredSignal, msg->par("seq").intValue());
+        if (oracle != nullptr) {
+            oracle->recordRoute(path.front(), getName(), path.size() - 1);
+        }
         delete msg;
     } else {
         forwardMessage(msg);
@@ -162,6 +278,7 @@ void BidirectionalLeafNode::forwardMessage(cMessage *msg) {
 
     if (routingTable.find(destination) == routingTable.end()) {
         sendRouteRequest(destination);
+        delete msg; // No route yet: the packet is lost
         return;
     }
 
@@ -196,8 +313,128 @@ std::vector<std::string> BidirectionalLeafNode::parsePath(const std::string &pat
     return nodes;
 }
 
+// Two paths to this node are disjoint if they share no intermediate node
+// (node-disjoint) or no hop (link-disjoint). The last node is this node.
+bool BidirectionalLeafNode::isDisjoint(const std::vector<std::string> &a, const std::vector<std::string> &b) {
+    if (linkDisjoint) {
+        std::set<std::pair<std::string, std::string>> links;
+        for (size_t i = 0; i + 1 < a.size(); ++i) {
+            links.insert(std::make_pair(a[i], a[i + 1]));
+        }
+        for (size_t i = 0; i + 1 < b.size(); ++i) {
+            if (links.find(std::make_pair(b[i], b[i + 1])) != links.end()) {
+                return false;
+            }
+        }
+        return a.size() != 1 || b.size() != 1; // Both direct: same single link
+    }
+
+    std::set<std::string> nodes(a.begin(), a.end());
+    nodes.erase(a.back());
+    for (size_t i = 0; i + 1 < b.size(); ++i) {
+        if (nodes.find(b[i]) != nodes.end()) {
+            return false;
+        }
+    }
+    return a != b;
+}
+
+// Add a route to the cache if the destination has none yet. Like
+// BidirectionalNode with one route per destination, later replies and
+// harvested paths do not replace the cached route.
+bool BidirectionalLeafNode::cacheRoute(const std::string &destination, const std::vector<std::string> &route) {
+    return routingTable.emplace(destination, route).second;
+}
+
+// Cache routes to the nodes of a path as seen from path[at]. Each route
+// starts with prefix, the overheard neighbor, or nothing if path[at] is this
+// node.
+void BidirectionalLeafNode::learnRoutes(const std::vector<std::string> &path, int at, const std::vector<std::string> &prefix) {
+    std::vector<std::string> route = prefix;
+    for (int j = at - 1; j >= 0 && path[j] != getName(); --j) {
+        route.push_back(path[j]);
+        routesLearned += cacheRoute(path[j], route);
+    }
+
+    route = prefix;
+    for (int j = at + 1; j < (int)path.size() && path[j] != getName(); ++j) {
+        route.push_back(path[j]);
+        routesLearned += cacheRoute(path[j], route);
+    }
+}
+
+void BidirectionalLeafNode::overhear(const std::string &sender, const std::vector<std::string> &path) {
+    if (!promiscuous) {
+        return;
+    }
+
+    auto senderIt = std::find(path.begin(), path.end(), sender);
+    if (senderIt == path.end() || std::find(path.begin(), path.end(), getName()) != path.end()) {
+        return;
+    }
+    std::vector<std::string> prefix(1, sender);
+    routesLearned += cacheRoute(sender, prefix);
+    learnRoutes(path, senderIt - path.begin(), prefix);
+}
+
+// Route cache, RREQ dedup set and answered RREQ paths
+void BidirectionalLeafNode::saveState(std::ostream &out) const {
+    using namespace checkpoint;
+
+    writeU32(out, routingTable.size());
+    for (const auto &entry : routingTable) {
+        writeString(out, entry.first);
+        writeRoute(out, entry.second);
+    }
+    writeStringSet(out, knownMessages);
+    writeU32(out, repliedPaths.size());
+    for (const auto &entry : repliedPaths) {
+        writeString(out, entry.first);
+        writeU32(out, entry.second.size());
+        for (const auto &route : entry.second) {
+            writeRoute(out, route);
+        }
+    }
+}
+
+void BidirectionalLeafNode::loadState(std::istream &in) {
+    using namespace checkpoint;
+
+    for (uint32_t n = readU32(in); n > 0; --n) {
+        std::string destination = readString(in);
+        routingTable[destination] = readRoute(in);
+    }
+    readStringSet(in, knownMessages);
+    for (uint32_t n = readU32(in); n > 0; --n) {
+        std::vector<std::vector<std::string>> &replied = repliedPaths[readString(in)];
+        for (uint32_t r = readU32(in); r > 0; --r) {
+            replied.push_back(readRoute(in));
+        }
+    }
+}
+
+void BidirectionalLeafNode::reportMemory(std::map<std::string, size_t> &bytes) const {
+    bytes["routingTable"] = memory::bytes(routingTable);
+    bytes["knownMessages"] = memory::bytes(knownMessages);
+    bytes["repliedPaths"] = memory::bytes(repliedPaths);
+}
+
+void BidirectionalLeafNode::sampleMetrics(std::map<std::string, double> &metrics) const {
+    metrics["transmissions"] = routingMsgCount;
+    metrics["route_discoveries"] = routeDiscoveries;
+    metrics["routes_learned"] = routesLearned;
+    metrics["packets_delivered"] = packetsDelivered;
+    metrics["route_cache_destinations"] = routingTable.size();
+    metrics["route_cache_entries"] = routingTable.size();
+    metrics["dedup_entries"] = knownMessages.size();
+}
+
 void BidirectionalLeafNode::finish() {
     EV << "Node " << getName() << " finished with " << routingMsgCount << " routing messages.\n";
+    recordScalar("transmissions", routingMsgCount);
+    recordScalar("packetsDelivered", packetsDelivered);
+    recordScalar("routeDiscoveries", routeDiscoveries);
+    recordScalar("routesLearned", routesLearned);
     EV << "Routing table:\n";
     for (const auto &entry : routingTable) {
         EV << "  Destination: " << entry.first << ", Path: ";
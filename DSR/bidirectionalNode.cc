@@ -5,48 +5,180 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
+#include <functional>
+#include "aggregation.h"
+#include "checkpoint.h"
+#include "lossyChannel.h"
+#include "memory.h"
+#include "metrics.h"
+#include "pathOracle.h"
+#include "promiscuous.h"
 
 using namespace omnetpp;
 
-class BidirectionalNode : public cSimpleModule {
+class BidirectionalNode : public cSimpleModule, public Checkpointable, public MetricsSource, public MemoryAccountable {
 private:
-    std::map<std::string, std::vector<std::string>> routingTable; // Routing table: destination -> route
+    std::map<std::string, std::vector<std::vector<std::string>>> routingTable; // Routing table: destination -> up to maxRoutes disjoint routes
+    std::map<std::string, std::vector<long>> routeLoad;          // Packets sent over each cached route, parallel to routingTable
+    std::map<std::string, std::vector<std::string>> flowRoutes;  // Flow -> route it is pinned to while that route stays cached
     std::set<std::string> knownMessages;                         // Avoid processing duplicate RREQs
+    std::map<std::string, std::vector<std::vector<std::string>>> repliedPaths; // RREQ paths answered as destination, per request
     int routingMsgCount = 0;                                     // Count of routing messages processed
+    int packetsDelivered = 0;                                    // Data messages received as destination
+    simsignal_t deliveredSignal;                                 // packetDelivered, counted by the source
+    PathOracle *oracle = nullptr;                                // Scores delivery paths, if the network has one
+    cMessage *checkpointEvent = nullptr;                         // Coordinator only: time to write the checkpoint
+
+    int maxRoutes = 1;                                           // Maximum number of disjoint routes kept per destination
+    bool linkDisjoint = false;                                   // Link-disjoint instead of node-disjoint routes
+    bool balanceByLoad = false;                                  // Least-loaded route instead of flow hash
+
+    bool harvestRoutes = false;                                  // Learn routes from the paths of RREQs, RREPs and data passing through
+    bool promiscuous = false;                                    // Also learn from paths overheard from neighbors
+    std::vector<int> overhearingGates;                           // Gates to neighbors that listen promiscuously
+    int routeDiscoveries = 0;                                    // RREQ floods started by this node
+    int routesLearned = 0;                                       // Routes cached by harvesting or overhearing
+    int routeErrors = 0;                                         // Data sends that found their link crashed
+
+    // Frame aggregation, see aggregation.h: RREQs, RREPs and data bound to
+    // the same neighbor share frames, so control headers ride along with data
+    bool aggregate = false;
+    simtime_t aggregationWindow;
+    int maxBundleSize = 8;
+    aggregation::Outbox outbox;
+    cMessage *aggregationEvent = nullptr;
+    long framesSent = 0;                                         // Frames put on the links; a bundle counts once
 
 protected:
-    virtual void initialize() override;
+    virtual int numInitStages() const override { return 2; }
+    virtual void initialize(int stage) override;
     virtual void handleMessage(cMessage *msg) override;
     virtual void finish() override;
 
     // DSR-specific methods
+    void handlePacket(cMessage *msg, cModule *senderNode);
     void sendRouteRequest(const std::string &destination);
-    void handleRouteRequest(cMessage *rreq);
+    void handleRouteRequest(cMessage *rreq, cModule *senderNode);
     void sendRouteReply(const std::string &destination, const std::string &source, const std::string &path);
     void handleRouteReply(cMessage *rrep);
     void forwardMessage(cMessage *msg);
     void handleDataMessage(cMessage *msg);
+    void sendRouteError(const std::vector<std::string> &route, int at);
+    void handleRouteError(cMessage *rerr);
 
     // Helper functions
+    void transmit(cMessage *msg, int gateIndex);
+    void flushOutbox();
     int findGateToNode(const std::string &nodeName);
     std::vector<std::string> parsePath(const std::string &path);
+
+    // Multipath helpers
+    bool isDisjoint(const std::vector<std::string> &a, const std::vector<std::string> &b);
+    bool cacheRoute(const std::string &destination, const std::vector<std::string> &route);
+    int selectRoute(const std::string &destination, const std::string &flowId);
+
+    // Route maintenance
+    bool linkCrashed(int gateIndex);
+    bool usesLink(const std::vector<std::string> &route, const std::string &a, const std::string &b);
+    void invalidateLink(const std::string &a, const std::string &b);
+
+    // Passive route learning
+    void learnRoutes(const std::vector<std::string> &path, int at, const std::vector<std::string> &prefix);
+    void notifyOverhearers(const std::string &path, int outGate);
+    void overhear(const std::string &sender, const std::vector<std::string> &path);
+
+public:
+    virtual ~BidirectionalNode();
+
+    // Checkpointable
+    virtual void saveState(std::ostream &out) const override;
+    virtual void loadState(std::istream &in) override;
+
+    virtual void sampleMetrics(std::map<std::string, double> &metrics) const override;
+    virtual void reportMemory(std::map<std::string, size_t> &bytes) const override;
 };
 
 Define_Module(BidirectionalNode);
 
-void BidirectionalNode::initialize() {
+BidirectionalNode::~BidirectionalNode() {
+    cancelAndDelete(checkpointEvent);
+    cancelAndDelete(aggregationEvent);
+}
+
+void BidirectionalNode::initialize(int stage) {
+    if (stage == 1) {
+        // Restore warm state and schedule the checkpoint on behalf of the network
+        cModule *network = getParentModule();
+        if (checkpoint::isCoordinator(this)) {
+            std::string restoreFile = network->par("restoreFile").stdstringValue();
+            if (!restoreFile.empty()) {
+                checkpoint::restore(network, restoreFile);
+            }
+            simtime_t checkpointTime = network->par("checkpointTime").doubleValue();
+            if (!network->par("checkpointFile").stdstringValue().empty() && checkpointTime >= 0) {
+                checkpointEvent = new cMessage("Checkpoint");
+                scheduleAt(checkpointTime, checkpointEvent);
+            }
+        }
+        return;
+    }
+
     routingMsgCount = 0;
+    deliveredSignal = registerSignal("packetDelivered");
+    oracle = PathOracle::find(this);
+
+    maxRoutes = par("maxRoutes");
+    linkDisjoint = std::string(par("disjointness").stringValue()) == "link";
+    balanceByLoad = std::string(par("routeSelection").stringValue()) == "load";
+    harvestRoutes = par("harvestRoutes");
+    promiscuous = par("promiscuous");
+    for (int i = 0; i < gateSize("io$o"); ++i) {
+        if (promiscuous::listens(gate("io$o", i)->getNextGate()->getOwnerModule())) {
+            overhearingGates.push_back(i);
+        }
+    }
+
+    aggregate = par("aggregate");
+    aggregationWindow = par("aggregationWindow").doubleValue();
+    maxBundleSize = par("maxBundleSize");
+    aggregationEvent = new cMessage("FlushOutbox");
+    aggregationEvent->setSchedulingPriority(1); // After everything else due at the same time
 }
 
 void BidirectionalNode::handleMessage(cMessage *msg) {
+    if (msg == checkpointEvent) {
+        checkpoint::save(getParentModule(), getParentModule()->par("checkpointFile").stdstringValue());
+        return;
+    }
+    if (msg == aggregationEvent) {
+        flushOutbox();
+        return;
+    }
+    if (aggregation::isBundle(msg)) {
+        cModule *senderNode = msg->getSenderModule();
+        for (cMessage *payload : aggregation::unbundle(msg)) {
+            handlePacket(payload, senderNode);
+        }
+        return;
+    }
+
+    handlePacket(msg, msg->getSenderModule());
+}
+
+void BidirectionalNode::handlePacket(cMessage *msg, cModule *senderNode) {
     int kind = msg->getKind();
 
     if (kind == 0) { // RREQ
-        handleRouteRequest(msg);
+        handleRouteRequest(msg, senderNode);
     } else if (kind == 1) { // RREP
         handleRouteReply(msg);
     } else if (kind == 2) { // Data message
         handleDataMessage(msg);
+    } else if (kind == 4) { // RERR
+        handleRouteError(msg);
+    } else if (kind == promiscuous::KIND) {
+        overhear(msg->par("sender").stringValue(), parsePath(msg->par("path").stringValue()));
+        delete msg;
     } else {
         EV << "Unknown message kind: " << kind << "\n";
         delete msg;
@@ -59,40 +191,56 @@ void BidirectionalNode::sendRouteRequest(const std::string &destination) {
     rreq->addPar("source") = getName();
     rreq->addPar("destination") = destination.c_str();
     rreq->addPar("path") = getName();
+    rreq->addPar("id") = routeDiscoveries++; // A new discovery after a route error is not a duplicate
 
     // Broadcast the RREQ to all neighbors
     for (int i = 0; i < gateSize("io$o"); ++i) {
         routingMsgCount++;
-        sendDelayed(rreq->dup(), 1, "io$o", i);
+        transmit(rreq->dup(), i);
     }
     delete rreq;
 }
 
-void BidirectionalNode::handleRouteRequest(cMessage *rreq) {
+void BidirectionalNode::handleRouteRequest(cMessage *rreq, cModule *senderNode) {
     std::string source = rreq->par("source").stringValue();
     std::string destination = rreq->par("destination").stringValue();
     std::string path = rreq->par("path").stringValue();
 
-    std::string messageId = source + "->" + destination; // Unique message ID
-    if (knownMessages.find(messageId) != knownMessages.end()) {
+    std::string messageId = source + "->" + destination + "#" + std::to_string(rreq->par("id").intValue()); // Unique message ID
+
+    // Every copy, duplicates included, carries a route back to its source
+    if (harvestRoutes) {
+        std::vector<std::string> reverse = parsePath(path + "-" + getName());
+        learnRoutes(reverse, reverse.size() - 1, std::vector<std::string>());
+    }
+
+    if (destination == getName()) {
+        // Reply to every RREQ copy whose path is disjoint from those already answered
+        std::vector<std::vector<std::string>> &replied = repliedPaths[messageId];
+        std::vector<std::string> route = parsePath(path + "-" + getName());
+        route.erase(route.begin()); // Compare from the first hop on, ending at this node
+
+        bool disjoint = (int)replied.size() < maxRoutes;
+        for (size_t i = 0; disjoint && i < replied.size(); ++i) {
+            disjoint = isDisjoint(replied[i], route);
+        }
+        if (disjoint) {
+            replied.push_back(route);
+            sendRouteReply(source, destination, path + "-" + getName());
+        }
         delete rreq;
         return;
     }
-    knownMessages.insert(messageId);
 
-    if (destination == getName()) {
-        sendRouteReply(source, destination, path + "-" + getName());
+    if (knownMessages.find(messageId) != knownMessages.end()) {
         delete rreq;
         return;
     }
+    knownMessages.insert(messageId);
 
     path += std::string("-") + getName();
     rreq->par("path") = path.c_str();
 
-    cGate *arrivalGate = rreq->getArrivalGate(); // Gate where the message arrived
-    cGate *connectedGate = arrivalGate->getPreviousGate(); // Gate of the sender
-    cModule *senderNode = connectedGate->getOwnerModule(); // Module of the sender
-
     // Forward the RREQ to all neighbors
     for (int i = 0; i < gateSize("io$o"); ++i) {
 
@@ -105,7 +253,7 @@ void BidirectionalNode::handleRouteRequest(cMessage *rreq) {
         }
 
         routingMsgCount++;
-        sendDelayed(rreq->dup(), 1, "io$o", i);
+        transmit(rreq->dup(), i);
     }
     delete rreq;
 }
@@ -123,7 +271,9 @@ void BidirectionalNode::sendRouteReply(const std::string &destination, const std
     std::string nextHop = route.back();
 
     if (nextHop != getName()) {
-        sendDelayed(rrep, 1, "io$o", findGateToNode(nextHop));
+        int outGate = findGateToNode(nextHop);
+        transmit(rrep, outGate);
+        notifyOverhearers(path, outGate);
     } else {
         delete rrep; // Already reached the destination
     }
@@ -146,45 +296,318 @@ void BidirectionalNode::handleRouteReply(cMessage *rrep) {
     }
 
     frontroute.assign(currentIt+1, route.end());
-    routingTable[source] = frontroute;
+    cacheRoute(source, frontroute);
+    if (harvestRoutes) {
+        learnRoutes(route, currentIt - route.begin(), std::vector<std::string>());
+    }
 
     backroute.assign(route.begin(), currentIt);
 
     if (!backroute.empty()) {
         std::string nextHop = backroute.back();
-        sendDelayed(rrep, 1, "io$o", findGateToNode(nextHop));
+        int outGate = findGateToNode(nextHop);
+        transmit(rrep, outGate);
+        notifyOverhearers(path, outGate);
         return;
     }
 
     delete rrep;
 }
 
+// Add a route to the cache if it is disjoint from every route already held for the destination
+bool BidirectionalNode::cacheRoute(const std::string &destination, const std::vector<std::string> &route) {
+    std::vector<std::vector<std::string>> &routes = routingTable[destination];
+
+    if ((int)routes.size() >= maxRoutes) {
+        return false;
+    }
+    for (const auto &cached : routes) {
+        if (!isDisjoint(cached, route)) {
+            return false;
+        }
+    }
+
+    routes.push_back(route);
+    routeLoad[destination].push_back(0);
+    return true;
+}
+
+// Cache routes to the nodes of a path as seen from path[at]: towards its start
+// through path[at-1], towards its end through path[at+1]. Each route starts
+// with prefix, the overheard neighbor, or nothing if path[at] is this node.
+void BidirectionalNode::learnRoutes(const std::vector<std::string> &path, int at, const std::vector<std::string> &prefix) {
+    std::vector<std::string> route = prefix;
+    for (int j = at - 1; j >= 0 && path[j] != getName(); --j) {
+        route.push_back(path[j]);
+        routesLearned += cacheRoute(path[j], route);
+    }
+
+    route = prefix;
+    for (int j = at + 1; j < (int)path.size() && path[j] != getName(); ++j) {
+        route.push_back(path[j]);
+        routesLearned += cacheRoute(path[j], route);
+    }
+}
+
+// Let the other promiscuous neighbors overhear the path of a unicast just
+// handed to transmit(): the copies leave when the frame does, after the
+// aggregation window if it is queued
+void BidirectionalNode::notifyOverhearers(const std::string &path, int outGate) {
+    if (overhearingGates.empty()) {
+        return;
+    }
+
+    simtime_t sendTime = aggregationEvent->isScheduled() ? aggregationEvent->getArrivalTime() : simTime();
+    for (int i : overhearingGates) {
+        if (i != outGate) {
+            sendDelayed(promiscuous::makeCopy(getName(), path), sendTime - simTime() + 1, "io$o", i);
+        }
+    }
+}
+
+void BidirectionalNode::overhear(const std::string &sender, const std::vector<std::string> &path) {
+    if (!promiscuous) {
+        return;
+    }
+
+    // Nodes on the path learn from the packet itself when it reaches them
+    auto senderIt = std::find(path.begin(), path.end(), sender);
+    if (senderIt == path.end() || std::find(path.begin(), path.end(), getName()) != path.end()) {
+        return;
+    }
+
+    std::vector<std::string> prefix(1, sender);
+    routesLearned += cacheRoute(sender, prefix);
+    learnRoutes(path, senderIt - path.begin(), prefix);
+}
+
+// Two routes to the same destination are disjoint if they share no intermediate node
+// (node-disjoint) or no hop (link-disjoint). The last node is the common destination.
+bool BidirectionalNode::isDisjoint(const std::vector<std::string> &a, const std::vector<std::string> &b) {
+    if (linkDisjoint) {
+        std::set<std::pair<std::string, std::string>> links;
+        for (size_t i = 0; i + 1 < a.size(); ++i) {
+            links.insert(std::make_pair(a[i], a[i + 1]));
+        }
+        for (size_t i = 0; i + 1 < b.size(); ++i) {
+            if (links.find(std::make_pair(b[i], b[i + 1])) != links.end()) {
+                return false;
+            }
+        }
+        return a.size() != 1 || b.size() != 1; // Both direct: same single link
+    }
+
+    std::set<std::string> nodes(a.begin(), a.end());
+    nodes.erase(a.back());
+    for (size_t i = 0; i + 1 < b.size(); ++i) {
+        if (nodes.find(b[i]) != nodes.end()) {
+            return false;
+        }
+    }
+    return a != b;
+}
+
+// Pick a cached route: the least-loaded one, or per flow so a flow keeps its
+// path. A flow is pinned to the route first hashed for it, so caching more
+// routes to the destination does not move it; it is re-hashed only once its
+// route is no longer cached.
+int BidirectionalNode::selectRoute(const std::string &destination, const std::string &flowId) {
+    std::vector<long> &load = routeLoad[destination];
+    const std::vector<std::vector<std::string>> &routes = routingTable[destination];
+
+    int index = 0;
+    if (balanceByLoad) {
+        index = std::min_element(load.begin(), load.end()) - load.begin();
+    } else {
+        auto pinned = flowRoutes.find(flowId);
+        auto cached = pinned == flowRoutes.end() ? routes.end() : std::find(routes.begin(), routes.end(), pinned->second);
+        if (cached != routes.end()) {
+            index = cached - routes.begin();
+        } else {
+            index = std::hash<std::string>()(flowId) % load.size();
+            flowRoutes[flowId] = routes[index];
+        }
+    }
+
+    load[index]++;
+    return index;
+}
+
 void BidirectionalNode::handleDataMessage(cMessage *msg) {
     std::string destination = msg->par("destination").stringValue();
 
-        simtime_t delay = simTime() - msg->getTimestamp();
+    // Data packets record the nodes they pass, for harvesting and loop detection
+    std::vector<std::string> path = parsePath(msg->par("path").stringValue());
+    if (std::find(path.begin(), path.end(), getName()) != path.end()) {
+        EV << "Dropping looping data packet at " << getName() << "\n";
+        delete msg;
+        return;
+    }
+    path.push_back(getName());
+    msg->par("path") = (std::string(msg->par("path").stringValue()) + "-" + getName()).c_str();
+    if (harvestRoutes) {
+        learnRoutes(path, path.size() - 1, std::vector<std::string>());
+    }
+
+    simtime_t delay = simTime() - msg->getTimestamp();
 
-        if (destination == getName()) {
-            EV << "Message received at destination: " << msg->par("payload").stringValue() << "\n";
-            EV << "End-to-end delay: " << delay << "\n";
-            delete msg;
-        } else {
-            forwardMessage(msg);
+    if (destination == getName()) {
+        EV << "Message received at destination: " << msg->par("payload").stringValue() << "\n";
+        EV << "End-to-end delay: " << delay << "\n";
+        packetsDelivered++;
+        emit(deliveredSignal, msg->par("seq").intValue());
+        if (oracle != nullptr) {
+            oracle->recordRoute(path.front(), getName(), path.size() - 1);
         }
+        delete msg;
+    } else {
+        forwardMessage(msg);
+    }
 }
 
+// The first node to route a packet picks one of its cached routes and stamps
+// it on the packet as "route"; the nodes after it follow that source route.
+// Routes picked independently from different caches could mix into loops.
 void BidirectionalNode::forwardMessage(cMessage *msg) {
     std::string destination = msg->par("destination").stringValue();
 
-    if (routingTable.find(destination) == routingTable.end()) {
-        sendRouteRequest(destination);
+    if (!msg->hasPar("route")) {
+        if (routingTable.find(destination) == routingTable.end()) {
+            sendRouteRequest(destination);
+            delete msg; // No route yet: the packet is lost
+            return;
+        }
+
+        std::string flowId = std::string(msg->par("source").stringValue()) + "->" + destination
+                           + "#" + std::to_string(msg->par("flow").intValue());
+        std::string sourceRoute = getName();
+        for (const std::string &hop : routingTable[destination][selectRoute(destination, flowId)]) {
+            sourceRoute += "-" + hop;
+        }
+        msg->addPar("route") = sourceRoute.c_str();
+    }
+
+    std::vector<std::string> route = parsePath(msg->par("route").stringValue());
+    auto at = std::find(route.begin(), route.end(), getName());
+    if (at == route.end() || at + 1 == route.end()) {
+        EV << "Dropping data packet off its source route at " << getName() << "\n";
+        delete msg;
+        return;
+    }
+
+    int outGate = findGateToNode(*(at + 1));
+    if (linkCrashed(outGate)) {
+        // Salvage the packet: forget the routes over the broken link, tell the
+        // nodes upstream on the source route, and route it again from here
+        routeErrors++;
+        invalidateLink(getName(), *(at + 1));
+        sendRouteError(route, at - route.begin());
+        delete msg->getParList().remove(msg->findPar("route"));
+        forwardMessage(msg);
+        return;
+    }
+
+    std::string path = msg->par("path").stringValue();
+    transmit(msg, outGate);
+    notifyOverhearers(path, outGate);
+}
+
+// Report the broken link after route[at] back along the source route, up to
+// the node that picked it
+void BidirectionalNode::sendRouteError(const std::vector<std::string> &route, int at) {
+    if (at == 0) {
+        return;
+    }
+
+    std::string sourceRoute = route.front();
+    for (size_t i = 1; i < route.size(); ++i) {
+        sourceRoute += "-" + route[i];
+    }
+
+    cMessage *rerr = new cMessage("RERR");
+    rerr->setKind(4); // 4 for RERR
+    rerr->addPar("from") = route[at].c_str();
+    rerr->addPar("to") = route[at + 1].c_str();
+    rerr->addPar("route") = sourceRoute.c_str();
+    routingMsgCount++;
+    transmit(rerr, findGateToNode(route[at - 1]));
+}
+
+void BidirectionalNode::handleRouteError(cMessage *rerr) {
+    invalidateLink(rerr->par("from").stringValue(), rerr->par("to").stringValue());
+
+    std::vector<std::string> route = parsePath(rerr->par("route").stringValue());
+    auto at = std::find(route.begin(), route.end(), getName());
+    if (at == route.end() || at == route.begin()) {
+        delete rerr; // Reached the node that picked the route
+        return;
+    }
+
+    routingMsgCount++;
+    transmit(rerr, findGateToNode(*(at - 1)));
+}
+
+// Link-layer feedback of a LossyLink: a send over a link with a crashed end fails
+bool BidirectionalNode::linkCrashed(int gateIndex) {
+    LossyChannel *channel = dynamic_cast<LossyChannel *>(gate("io$o", gateIndex)->getChannel());
+    return channel != nullptr && channel->isCrashed(simTime());
+}
+
+// Whether a cached route, which starts at this node, crosses the link a-b
+bool BidirectionalNode::usesLink(const std::vector<std::string> &route, const std::string &a, const std::string &b) {
+    std::string previous = getName();
+    for (const std::string &hop : route) {
+        if ((previous == a && hop == b) || (previous == b && hop == a)) {
+            return true;
+        }
+        previous = hop;
+    }
+    return false;
+}
+
+// Drop the cached routes over a broken link, and the flows pinned to them
+void BidirectionalNode::invalidateLink(const std::string &a, const std::string &b) {
+    for (auto entry = routingTable.begin(); entry != routingTable.end();) {
+        std::vector<std::vector<std::string>> &routes = entry->second;
+        std::vector<long> &load = routeLoad[entry->first];
+        for (size_t i = routes.size(); i-- > 0;) {
+            if (usesLink(routes[i], a, b)) {
+                routes.erase(routes.begin() + i);
+                load.erase(load.begin() + i);
+            }
+        }
+        if (routes.empty()) {
+            routeLoad.erase(entry->first);
+            entry = routingTable.erase(entry);
+        } else {
+            ++entry;
+        }
+    }
+
+    for (auto pin = flowRoutes.begin(); pin != flowRoutes.end();) {
+        pin = usesLink(pin->second, a, b) ? flowRoutes.erase(pin) : std::next(pin);
+    }
+}
+
+// Send a packet now, or queue it for the next aggregated frame on its gate
+void BidirectionalNode::transmit(cMessage *msg, int gateIndex) {
+    if (!aggregate) {
+        framesSent++;
+        sendDelayed(msg, 1, "io$o", gateIndex);
         return;
     }
 
-    std::vector<std::string> route = routingTable[destination];
+    outbox.add(gateIndex, msg);
+    if (!aggregationEvent->isScheduled()) {
+        scheduleAt(simTime() + aggregationWindow, aggregationEvent);
+    }
+}
 
-    std::string nextHop = route.front();
-    sendDelayed(msg, 1, "io$o", findGateToNode(nextHop));
+void BidirectionalNode::flushOutbox() {
+    for (const auto &frame : outbox.takeFrames(maxBundleSize)) {
+        framesSent++;
+        sendDelayed(frame.second, 1, "io$o", frame.first);
+    }
 }
 
 int BidirectionalNode::findGateToNode(const std::string &nodeName) {
@@ -211,14 +634,88 @@ std::vector<std::string> BidirectionalNode::parsePath(const std::string &path) {
     return nodes;
 }
 
+// Route cache, RREQ dedup set and answered RREQ paths
+void BidirectionalNode::saveState(std::ostream &out) const {
+    using namespace checkpoint;
+
+    writeU32(out, routingTable.size());
+    for (const auto &entry : routingTable) {
+        writeString(out, entry.first);
+        writeU32(out, entry.second.size());
+        for (const auto &route : entry.second) {
+            writeRoute(out, route);
+        }
+    }
+    writeStringSet(out, knownMessages);
+    writeU32(out, repliedPaths.size());
+    for (const auto &entry : repliedPaths) {
+        writeString(out, entry.first);
+        writeU32(out, entry.second.size());
+        for (const auto &route : entry.second) {
+            writeRoute(out, route);
+        }
+    }
+}
+
+void BidirectionalNode::loadState(std::istream &in) {
+    using namespace checkpoint;
+
+    for (uint32_t n = readU32(in); n > 0; --n) {
+        std::string destination = readString(in);
+        for (uint32_t r = readU32(in); r > 0; --r) {
+            cacheRoute(destination, readRoute(in));
+        }
+    }
+    readStringSet(in, knownMessages);
+    for (uint32_t n = readU32(in); n > 0; --n) {
+        std::vector<std::vector<std::string>> &replied = repliedPaths[readString(in)];
+        for (uint32_t r = readU32(in); r > 0; --r) {
+            replied.push_back(readRoute(in));
+        }
+    }
+}
+
+void BidirectionalNode::reportMemory(std::map<std::string, size_t> &bytes) const {
+    bytes["routingTable"] = memory::bytes(routingTable);
+    bytes["routeLoad"] = memory::bytes(routeLoad);
+    bytes["flowRoutes"] = memory::bytes(flowRoutes);
+    bytes["knownMessages"] = memory::bytes(knownMessages);
+    bytes["repliedPaths"] = memory::bytes(repliedPaths);
+}
+
+void BidirectionalNode::sampleMetrics(std::map<std::string, double> &metrics) const {
+    size_t routes = 0;
+    for (const auto &entry : routingTable) {
+        routes += entry.second.size();
+    }
+    metrics["transmissions"] = routingMsgCount;
+    metrics["route_discoveries"] = routeDiscoveries;
+    metrics["routes_learned"] = routesLearned;
+    metrics["route_errors"] = routeErrors;
+    metrics["packets_delivered"] = packetsDelivered;
+    metrics["route_cache_destinations"] = routingTable.size();
+    metrics["route_cache_entries"] = routes;
+    metrics["dedup_entries"] = knownMessages.size();
+    metrics["frames_sent"] = framesSent;
+    metrics["outbox_entries"] = outbox.size();
+}
+
 void BidirectionalNode::finish() {
     EV << "Node " << getName() << " finished with " << routingMsgCount << " routing messages.\n";
+    recordScalar("transmissions", routingMsgCount);
+    recordScalar("packetsDelivered", packetsDelivered);
+    recordScalar("routeDiscoveries", routeDiscoveries);
+    recordScalar("routesLearned", routesLearned);
+    recordScalar("routeErrors", routeErrors);
+    recordScalar("framesSent", framesSent);
     EV << "Routing table:\n";
     for (const auto &entry : routingTable) {
-        EV << "  Destination: " << entry.first << ", Path: ";
-        for (const std::string &node : entry.second) {
-            EV << node << " ";
+        for (size_t i = 0; i < entry.second.size(); ++i) {
+            EV << "  Destination: " << entry.first << ", Path: ";
+            for (const std::string &node : entry.second[i]) {
+                EV << node << " ";
+            }
+            EV << "(" << routeLoad[entry.first][i] << " packets)\n";
         }
-        EV << "\n";
     }
 }
@@ -1,17 +1,32 @@
 #include <omnetpp.h>
+#include <map>
 
 using namespace omnetpp;
 
-class BidirectionalSourceNode : public cSimpleModule {
+class BidirectionalSourceNode : public cSimpleModule, public cListener {
+  private:
+    int packetsSent = 0;
+    int flows = 1;                  // Flow labels handed out round-robin, for per-flow routing
+    simsignal_t deliveredSignal;
+    std::map<long, int> deliveries; // Packet ID -> receivers reached
+
   protected:
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+    // Counts the packetDelivered signals emitted by the receivers
+    virtual void receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) override;
 };
 
 Define_Module(BidirectionalSourceNode);
 
 
 void BidirectionalSourceNode::initialize() {
+   deliveredSignal = registerSignal("packetDelivered");
+   getParentModule()->subscribe(deliveredSignal, this);
+   flows = par("flows");
+
     simtime_t startTime = simTime();
     simtime_t interval = 20;
 
@@ -34,10 +49,32 @@ void BidirectionalSourceNode::handleMessage(cMessage *msg) {
         dsrMsg->addPar("destination") = "node32";
         dsrMsg->addPar("path") = getName(); // Initialize the path with the current node
         dsrMsg->addPar("payload") = "Hello!";
+        dsrMsg->addPar("seq") = msg->getKind(); // Packet ID for delivery accounting
+        dsrMsg->addPar("flow") = msg->getKind() % flows;
 
         // Send the DSR message
+        packetsSent++;
         sendDelayed(dsrMsg, 1, "io$o");
     }
 
     delete msg;
 }
+
+void BidirectionalSourceNode::receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) {
+    deliveries[value]++;
+}
+
+void BidirectionalSourceNode::finish() {
+    recordScalar("packetsSent", packetsSent);
+
+    int receivers = 1; // Unicast to a single destination
+
+    // Delivery ratio of each packet, and their distribution
+    cStdDev deliveryStats("deliveryRatio");
+    for (int id = 0; id < packetsSent; ++id) {
+        double ratio = (double)deliveries[id] / receivers;
+        deliveryStats.collect(ratio);
+        recordScalar(("deliveryRatio-" + std::to_string(id)).c_str(), ratio);
+    }
+    recordStatistic(&deliveryStats);
+}
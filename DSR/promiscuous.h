@@ -0,0 +1,37 @@
+#ifndef PROMISCUOUS_H
+#define PROMISCUOUS_H
+
+#include <omnetpp.h>
+#include <string>
+
+using namespace omnetpp;
+
+// Promiscuous overhearing.
+//
+// The topology is point-to-point, so there is no shared medium to overhear.
+// Instead a node that unicasts a source-routed packet (RREP or data) sends an
+// "Overheard" copy carrying the packet's path to each other neighbor with
+// promiscuous = true. The copies leave when the packet does and cross the
+// links like any frame, so they arrive with it and are lost with it on lossy
+// or crashed links. They are not counted as transmissions: on a shared medium
+// they would be the same frame. Listeners learn routes through the sender.
+
+namespace promiscuous {
+
+const short KIND = 3;
+
+inline bool listens(cModule *node) {
+    return node->hasPar("promiscuous") && node->par("promiscuous").boolValue();
+}
+
+inline cMessage *makeCopy(const std::string &sender, const std::string &path) {
+    cMessage *copy = new cMessage("Overheard");
+    copy->setKind(KIND);
+    copy->addPar("sender") = sender.c_str();
+    copy->addPar("path") = path.c_str();
+    return copy;
+}
+
+} // namespace promiscuous
+
+#endif
@@ -0,0 +1,163 @@
+"""
+Regression checks that need more than one simulation run.
+
+Each check runs configs of a project's omnetpp.ini and compares or tests
+their scalars. Build the simulations and floodEngine first. Exits with
+status 1 if any check fails.
+
+Example:
+    python checks.py
+    python checks.py checkpoint
+"""
+
+import argparse
+import math
+import os
+import subprocess
+import sys
+
+from replicate import executable, read_scalars
+
+
+def run(project, config):
+    """Run repetition 0 of a config and return its scalars."""
+    subprocess.run([executable(project), "-u", "Cmdenv", "-c", config, "-r", "0",
+                    "--cmdenv-express-mode=true"],
+                   cwd=project, check=True, stdout=subprocess.DEVNULL)
+    return read_scalars(os.path.join(project, "results", f"{config}-#0.sca"))
+
+
+def delivery_ratios(scalars):
+    """Broadcast ID -> delivery ratio, as recorded by the source."""
+    return {int(name.split("-")[1]): value for (module, name), value in scalars.items()
+            if name.startswith("deliveryRatio-")}
+
+
+def check_checkpoint():
+    """
+    A smartGossip run warm-started from a checkpoint continues the broadcast
+    IDs of the checkpointed run and delivers those broadcasts like the
+    uninterrupted run does.
+    """
+    full = delivery_ratios(run("smartGossip", "CheckpointFull"))
+    restored = delivery_ratios(run("smartGossip", "CheckpointRestored"))
+
+    failures = []
+    if min(restored) <= min(full):
+        failures.append(f"restored run reuses broadcast IDs from {min(restored)}")
+    common = sorted(set(full) & set(restored))
+    if not common:
+        failures.append("no broadcast ID in both runs")
+    for id in common:
+        if full[id] != restored[id]:
+            failures.append(f"broadcast {id}: delivery ratio {restored[id]} restored, {full[id]} uninterrupted")
+    return failures
+
+
+def check_aggregate_repair():
+    """
+    With aggregation and repair both on, the source answers the NACKs that
+    reach it inside bundles.
+    """
+    scalars = run("smartGossip", "AggregateRepair")
+    failures = []
+    if scalars.get(("RandomNetwork2.source", "repairsSent"), 0) == 0:
+        failures.append("source sent no repairs")
+    if scalars.get(("RandomNetwork2.node0", "repairsReceived"), 0) == 0:
+        failures.append("node0 received no repairs")
+    return failures
+
+
+def transmissions_per_delivery(scalars):
+    """Transmissions of all nodes per broadcast delivered to a receiver."""
+    transmissions = sum(v for (module, name), v in scalars.items() if name == "transmissions")
+    delivered = sum(v for (module, name), v in scalars.items() if name == "broadcastsReceived")
+    return transmissions / delivered if delivered > 0 else float("inf")
+
+
+def check_adaptive_threshold():
+    """
+    The adaptive gossip threshold, driven by observed loss and redundancy,
+    delivers broadcasts with fewer transmissions than the fixed threshold 0.8.
+    """
+    fixed = transmissions_per_delivery(run("smartGossip", "RandomNetwork2"))
+    adaptive = transmissions_per_delivery(run("smartGossip", "AdaptiveThreshold"))
+    if adaptive >= fixed:
+        return [f"{adaptive:.3f} transmissions per delivery adaptive, {fixed:.3f} with the fixed threshold"]
+    return []
+
+
+def check_flood_engine():
+    """
+    The scalars of a flooding run on RandomNetwork2 match the values
+    floodEngine computes analytically for the same topology.
+    """
+    run("flooding", "RandomNetwork2")
+    engine = os.path.join("floodEngine", "floodEngine")
+    if not os.path.exists(engine):
+        raise FileNotFoundError("floodEngine: build it first (make -C floodEngine)")
+    result = subprocess.run([engine, "-c", os.path.join("flooding", "results", "RandomNetwork2-#0.sca"),
+                             os.path.join("flooding", "RandomNetwork2.ned")],
+                            capture_output=True, text=True)
+    if result.returncode != 0:
+        return [line for line in result.stdout.splitlines() + result.stderr.splitlines() if line]
+    return []
+
+
+# Batched copies skip the link, so framesSent differs by design
+FLOODING_OUTCOME = {"transmissions", "broadcastsReceived", "duplicatesReceived", "scopeSuppressed",
+                    "meanLatency", "packetsSent"}
+
+
+def check_batch_arrivals():
+    """
+    Batching same-time arrivals in flooding is only an event-count
+    optimization: every node and the source record the same outcome as with
+    batchArrivals off.
+    """
+    def outcome(scalars):
+        return {key: value for key, value in scalars.items()
+                if key[1] in FLOODING_OUTCOME or key[1].startswith("deliveryRatio-")}
+
+    unbatched = outcome(run("flooding", "RandomNetwork2"))
+    batched = outcome(run("flooding", "BatchedArrivals"))
+    failures = []
+    for key in sorted(set(unbatched) | set(batched)):
+        # meanLatency may sum the same delays in another order
+        if key not in unbatched or key not in batched or not math.isclose(unbatched[key], batched[key]):
+            failures.append(f"{key[0]} {key[1]}: {batched.get(key)} batched, {unbatched.get(key)} unbatched")
+    if not unbatched:
+        failures.append("no scalars recorded")
+    return failures
+
+
+CHECKS = {
+    "checkpoint": check_checkpoint,
+    "aggregate-repair": check_aggregate_repair,
+    "adaptive-threshold": check_adaptive_threshold,
+    "flood-engine": check_flood_engine,
+    "batch-arrivals": check_batch_arrivals,
+}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run regression checks over simulation runs.")
+    parser.add_argument("checks", nargs="*", help=f"checks to run (default: all of {', '.join(CHECKS)})")
+    args = parser.parse_args()
+    for name in args.checks:
+        if name not in CHECKS:
+            parser.error(f"unknown check '{name}'")
+
+    os.chdir(os.path.dirname(os.path.abspath(__file__)))
+    failed = False
+    for name in args.checks or list(CHECKS):
+        failures = CHECKS[name]()
+        print(f"{name}: {'FAIL' if failures else 'ok'}")
+        for failure in failures:
+            print(f"  {failure}")
+        failed = failed or bool(failures)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,96 @@
+#ifndef AGGREGATION_H
+#define AGGREGATION_H
+
+#include <omnetpp.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace omnetpp;
+
+// Frame aggregation.
+//
+// A forwarding node with aggregate = true does not send its copies right
+// away: it queues them per output gate in an Outbox and flushes the outbox
+// aggregationWindow later (0: at the end of the current simulation time, after
+// everything else due now). Copies queued for the same gate go out as one
+// "Bundle" frame of at most maxBundleSize payloads; a lone copy is sent as is.
+// Receivers unbundle and handle the payloads one by one, as if each had
+// arrived on its own, so protocols need no other change.
+
+namespace aggregation {
+
+inline bool isBundle(cMessage *msg) {
+    return strcmp(msg->getName(), "Bundle") == 0;
+}
+
+// Takes the payloads out of a bundle and deletes it
+inline std::vector<cMessage *> unbundle(cMessage *bundle) {
+    std::vector<cMessage *> payloads;
+    cArray &objects = bundle->getParList();
+    for (int i = 0; i < objects.size(); ++i) {
+        cMessage *payload = dynamic_cast<cMessage *>(objects.get(i));
+        if (payload != nullptr) {
+            payloads.push_back(payload);
+        }
+    }
+    for (cMessage *payload : payloads) {
+        bundle->removeObject(payload);
+    }
+    delete bundle;
+    return payloads;
+}
+
+class Outbox {
+  private:
+    std::map<int, std::vector<cMessage *>> queued;  // Gate index -> copies waiting
+
+  public:
+    ~Outbox() {
+        for (auto &entry : queued) {
+            for (cMessage *msg : entry.second) {
+                delete msg;
+            }
+        }
+    }
+
+    void add(int gateIndex, cMessage *msg) {
+        queued[gateIndex].push_back(msg);
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const auto &entry : queued) {
+            total += entry.second.size();
+        }
+        return total;
+    }
+
+    // Empties the outbox into (gate index, frame) pairs to send
+    std::vector<std::pair<int, cMessage *>> takeFrames(int maxBundleSize) {
+        std::vector<std::pair<int, cMessage *>> frames;
+        for (auto &entry : queued) {
+            std::vector<cMessage *> &msgs = entry.second;
+            for (size_t first = 0; first < msgs.size(); first += maxBundleSize) {
+                size_t last = std::min(msgs.size(), first + maxBundleSize);
+                if (last - first == 1) {
+                    frames.push_back(std::make_pair(entry.first, msgs[first]));
+                    continue;
+                }
+                cMessage *bundle = new cMessage("Bundle");
+                for (size_t i = first; i < last; ++i) {
+                    bundle->addObject(msgs[i]);
+                }
+                frames.push_back(std::make_pair(entry.first, bundle));
+            }
+        }
+        queued.clear();
+        return frames;
+    }
+};
+
+} // namespace aggregation
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <omnetpp.h>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace omnetpp;
+
+// Warm-state checkpointing.
+//
+// Nodes that implement Checkpointable can have their protocol state (route
+// caches, neighbor tables, dedup sets) written to a binary file at a chosen
+// simulation time and restored at startup of a later run. The network
+// parameters checkpointFile/checkpointTime/restoreFile control it; the first
+// Checkpointable submodule of the network saves and restores all nodes.
+//
+// File layout: "WARM", version, record count, then per node its name and
+// a length-prefixed payload written by saveState().
+
+class Checkpointable {
+  public:
+    virtual ~Checkpointable() {}
+    virtual void saveState(std::ostream &out) const = 0;
+    virtual void loadState(std::istream &in) = 0;
+
+    // False for modules that only hold state and leave saving and restoring
+    // the network to a node that does
+    virtual bool canCoordinate() const { return true; }
+};
+
+namespace checkpoint {
+
+const uint32_t VERSION = 2;
+
+inline void writeU32(std::ostream &out, uint32_t value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+inline uint32_t readU32(std::istream &in) {
+    uint32_t value = 0;
+    in.read(reinterpret_cast<char *>(&value), sizeof(value));
+    return value;
+}
+
+inline void writeDouble(std::ostream &out, double value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+inline double readDouble(std::istream &in) {
+    double value = 0;
+    in.read(reinterpret_cast<char *>(&value), sizeof(value));
+    return value;
+}
+
+inline void writeString(std::ostream &out, const std::string &value) {
+    writeU32(out, value.size());
+    out.write(value.data(), value.size());
+}
+
+inline std::string readString(std::istream &in) {
+    std::string value(readU32(in), '\0');
+    in.read(&value[0], value.size());
+    return value;
+}
+
+template <typename Set>
+void writeStringSet(std::ostream &out, const Set &values) {
+    writeU32(out, values.size());
+    for (const std::string &value : values) {
+        writeString(out, value);
+    }
+}
+
+template <typename Set>
+void readStringSet(std::istream &in, Set &values) {
+    for (uint32_t n = readU32(in); n > 0; --n) {
+        values.insert(readString(in));
+    }
+}
+
+inline void writeRoute(std::ostream &out, const std::vector<std::string> &route) {
+    writeU32(out, route.size());
+    for (const std::string &hop : route) {
+        writeString(out, hop);
+    }
+}
+
+inline std::vector<std::string> readRoute(std::istream &in) {
+    std::vector<std::string> route(readU32(in));
+    for (std::string &hop : route) {
+        hop = readString(in);
+    }
+    return route;
+}
+
+// The node that saves and restores on behalf of the whole network
+inline bool isCoordinator(cModule *node) {
+    for (cModule::SubmoduleIterator it(node->getParentModule()); !it.end(); ++it) {
+        Checkpointable *candidate = dynamic_cast<Checkpointable *>(*it);
+        if (candidate != nullptr && candidate->canCoordinate()) {
+            return *it == node;
+        }
+    }
+    return false;
+}
+
+inline void save(cModule *network, const std::string &fileName) {
+    std::vector<std::pair<std::string, std::string>> records;
+    for (cModule::SubmoduleIterator it(network); !it.end(); ++it) {
+        Checkpointable *node = dynamic_cast<Checkpointable *>(*it);
+        if (node != nullptr) {
+            std::ostringstream payload;
+            node->saveState(payload);
+            records.push_back(std::make_pair(std::string((*it)->getFullName()), payload.str()));
+        }
+    }
+
+    std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw cRuntimeError("Cannot write checkpoint file '%s'", fileName.c_str());
+    }
+    out.write("WARM", 4);
+    writeU32(out, VERSION);
+    writeU32(out, records.size());
+    for (const auto &record : records) {
+        writeString(out, record.first);
+        writeString(out, record.second);
+    }
+}
+
+inline void restore(cModule *network, const std::string &fileName) {
+    std::ifstream in(fileName, std::ios::binary);
+    char magic[4] = {};
+    in.read(magic, 4);
+    if (!in || std::string(magic, 4) != "WARM" || readU32(in) != VERSION) {
+        throw cRuntimeError("'%s' is not a valid checkpoint file", fileName.c_str());
+    }
+
+    std::map<std::string, std::string> records;
+    for (uint32_t n = readU32(in); n > 0 && in; --n) {
+        std::string name = readString(in);
+        records[name] = readString(in);
+    }
+
+    for (cModule::SubmoduleIterator it(network); !it.end(); ++it) {
+        Checkpointable *node = dynamic_cast<Checkpointable *>(*it);
+        auto record = records.find((*it)->getFullName());
+        if (node != nullptr && record != records.end()) {
+            std::istringstream payload(record->second);
+            node->loadState(payload);
+        }
+    }
+}
+
+} // namespace checkpoint
+
+#endif
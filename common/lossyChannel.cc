@@ -0,0 +1,144 @@
+#include <omnetpp.h>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include "lossyChannel.h"
+
+Define_Channel(LossyChannel);
+
+// SplitMix64 finalizer
+static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// FNV-1a, stable across builds unlike std::hash
+static uint64_t hashString(const std::string &s) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : s) {
+        h = (h ^ c) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+void LossyChannel::initialize() {
+    cDelayChannel::initialize();
+
+    std::string a = getSourceGate()->getOwnerModule()->getFullName();
+    std::string b = getSourceGate()->getNextGate()->getOwnerModule()->getFullName();
+
+    linkKey = mix(hashString(getEnvir()->getConfigEx()->getVariable(CFGVAR_SEEDSET)) ^ hashString(a + ">" + b));
+
+    std::string model = par("lossModel").stdstringValue();
+    if (model == "uniform") {
+        lossModel = UNIFORM;
+        lossProbability = par("lossProbability");
+    } else if (model == "file") {
+        // Lines "nodeA nodeB probability", links not listed are lossless
+        lossModel = UNIFORM;
+        lossProbability = lookupLinkLoss(par("lossFile").stdstringValue(), a, b);
+    } else if (model == "gilbert") {
+        lossModel = GILBERT;
+        goodToBad = par("gilbertGoodToBad");
+        badToGood = par("gilbertBadToGood");
+        lossGood = par("gilbertLossGood");
+        lossBad = par("gilbertLossBad");
+        gilbertSlot = par("gilbertSlot");
+    } else if (model != "none") {
+        throw cRuntimeError("Unknown lossModel '%s'", model.c_str());
+    }
+
+    // Entries "node@from-to" (down from..to) or "node@from" (never recovers).
+    // Down only silences this link; the node keeps its state and timers.
+    std::stringstream schedule(par("crashSchedule").stdstringValue());
+    std::string entry;
+    while (schedule >> entry) {
+        size_t at = entry.find('@');
+        size_t dash = entry.find('-', at);
+        if (at == std::string::npos) {
+            throw cRuntimeError("Bad crashSchedule entry '%s'", entry.c_str());
+        }
+        Outage outage;
+        outage.node = entry.substr(0, at);
+        outage.from = std::stod(entry.substr(at + 1, dash - at - 1));
+        outage.to = dash == std::string::npos ? SIMTIME_MAX : std::stod(entry.substr(dash + 1));
+        if (outage.node == a || outage.node == b) {
+            outages.push_back(outage);
+        }
+    }
+}
+
+cChannel::Result LossyChannel::processMessage(cMessage *msg, const SendOptions& options, simtime_t t) {
+    Result result = cDelayChannel::processMessage(msg, options, t);
+
+    cModule *sender = getSourceGate()->getOwnerModule();
+    cModule *receiver = getSourceGate()->getNextGate()->getOwnerModule();
+    if (isDown(sender, t) || isDown(receiver, t + result.delay)) {
+        crashDrops++;
+        result.discard = true;
+        return result;
+    }
+
+    double loss = lossProbability;
+    if (lossModel == GILBERT) {
+        for (long slot = (long)std::floor(SIMTIME_DBL(t) / gilbertSlot); stateSlot < slot;) {
+            stateSlot++;
+            badState = draw(1, stateSlot) < (badState ? 1 - badToGood : goodToBad);
+        }
+        loss = badState ? lossBad : lossGood;
+    }
+    uint64_t sendTime = (uint64_t)std::llround(SIMTIME_DBL(t) * 1e6); // Microseconds
+    if (lossModel != NONE && draw(2 + msg->getKind(), sendTime) < loss) {
+        lossDrops++;
+        result.discard = true;
+    }
+    return result;
+}
+
+// Uniform [0, 1) draw of this link for (salt, value), the same in every run
+// with the same seed set
+double LossyChannel::draw(uint64_t salt, uint64_t value) const {
+    return (mix(linkKey ^ mix(salt) ^ mix(value ^ 0x5555555555555555ULL)) >> 11) * 0x1.0p-53;
+}
+
+bool LossyChannel::isCrashed(simtime_t t) const {
+    cModule *sender = getSourceGate()->getOwnerModule();
+    cModule *receiver = getSourceGate()->getNextGate()->getOwnerModule();
+    return isDown(sender, t) || isDown(receiver, t + getDelay());
+}
+
+bool LossyChannel::isDown(cModule *node, simtime_t t) const {
+    for (const Outage &outage : outages) {
+        if (outage.node == node->getFullName() && t >= outage.from && t < outage.to) {
+            return true;
+        }
+    }
+    return false;
+}
+
+double LossyChannel::lookupLinkLoss(const std::string &fileName, const std::string &a, const std::string &b) {
+    std::ifstream in(fileName);
+    if (!in) {
+        throw cRuntimeError("Cannot open lossFile '%s'", fileName.c_str());
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::stringstream ss(line.substr(0, line.find('#')));
+        std::string u, v;
+        double p;
+        if ((ss >> u >> v >> p) && ((u == a && v == b) || (u == b && v == a))) {
+            return p;
+        }
+    }
+    return 0;
+}
+
+void LossyChannel::finish() {
+    if (lossModel != NONE || !outages.empty()) {
+        recordScalar("lossDrops", lossDrops);
+        recordScalar("crashDrops", crashDrops);
+    }
+}
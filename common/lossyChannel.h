@@ -0,0 +1,71 @@
+#ifndef LOSSYCHANNEL_H
+#define LOSSYCHANNEL_H
+
+#include <omnetpp.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace omnetpp;
+
+// Link with fault injection: drops messages with a per-link loss model and
+// while either end is crashed according to the crash schedule.
+//
+// A "crash" is link silence, not a node failure: every message to or from the
+// node is dropped for the outage, but the node module itself keeps running.
+// Its state (duplicate caches, route caches, neighbor tables) survives and its
+// timers keep firing, so after the outage it resumes where it stopped instead
+// of rebooting empty. Protocols see a crashed neighbor only through the
+// missing traffic (or isCrashed() below).
+//
+// Loss decisions are not drawn from an RNG stream: each one hashes the run's
+// seed set, the link direction and the message's send time and kind. A
+// shared stream would hand every protocol a different loss realization, as
+// they send different numbers of messages in different orders. With the hash,
+// protocols run with the same seed set see the same losses on the same link at
+// the same time, which common random numbers comparisons need. The loss draws
+// also leave the protocols' own uniform() streams untouched.
+class LossyChannel : public cDelayChannel {
+  private:
+    enum LossModel { NONE, UNIFORM, GILBERT };
+
+    struct Outage {
+        std::string node;
+        simtime_t from;
+        simtime_t to;
+    };
+
+    LossModel lossModel = NONE;
+    double lossProbability = 0;     // UNIFORM: per-message loss
+
+    // Gilbert-Elliott two-state bursty loss, stepped once per gilbertSlot of
+    // simulation time whether or not messages are sent
+    bool badState = false;
+    long stateSlot = -1;            // Last slot the state was stepped to
+    double gilbertSlot = 1;
+    double goodToBad = 0;
+    double badToGood = 0;
+    double lossGood = 0;
+    double lossBad = 0;
+
+    std::vector<Outage> outages;
+    uint64_t linkKey = 0;           // Seed set and link direction, see draw()
+    long lossDrops = 0;
+    long crashDrops = 0;
+
+  protected:
+    virtual void initialize() override;
+    virtual Result processMessage(cMessage *msg, const SendOptions& options, simtime_t t) override;
+    virtual void finish() override;
+
+    bool isDown(cModule *node, simtime_t t) const;
+    double draw(uint64_t salt, uint64_t value) const;
+    double lookupLinkLoss(const std::string &fileName, const std::string &a, const std::string &b);
+
+  public:
+    // Link-layer feedback for the sender: true if a message sent at t is
+    // dropped because either end is crashed. Random losses are not reported.
+    bool isCrashed(simtime_t t) const;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Memory accounting of protocol state.
+//
+// Nodes that implement MemoryAccountable report the bytes held by each of
+// their data structures; the MetricsExporter aggregates them over the
+// network, samples them over time and flags heavy-hitter nodes.
+//
+// memory::bytes() estimates the footprint of a container from the libstdc++
+// layout: the object itself, a 32-byte header per tree node (std::set/map),
+// a next pointer and cached hash per hash node plus the bucket array
+// (std::unordered_*), and heap buffers of strings longer than the small-string
+// buffer. Allocator overhead is not included, so real usage is a bit higher.
+
+class MemoryAccountable {
+  public:
+    virtual ~MemoryAccountable() {}
+    virtual void reportMemory(std::map<std::string, size_t> &bytes) const = 0;
+};
+
+namespace memory {
+
+const size_t TREE_NODE = 32;
+const size_t HASH_NODE = sizeof(void *) + sizeof(size_t);
+
+// Heap bytes owned by a value, beyond sizeof() of the value itself
+template <typename T> size_t heapBytes(const T &) { return 0; }
+inline size_t heapBytes(const std::string &s);
+template <typename A, typename B> size_t heapBytes(const std::pair<A, B> &p);
+template <typename T> size_t heapBytes(const std::vector<T> &v);
+template <typename T> size_t heapBytes(const std::deque<T> &d);
+template <typename K, typename C> size_t heapBytes(const std::set<K, C> &s);
+template <typename K, typename V, typename C> size_t heapBytes(const std::map<K, V, C> &m);
+template <typename K, typename H, typename E> size_t heapBytes(const std::unordered_set<K, H, E> &s);
+template <typename K, typename V, typename H, typename E> size_t heapBytes(const std::unordered_map<K, V, H, E> &m);
+
+inline size_t heapBytes(const std::string &s) {
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+
+template <typename A, typename B> size_t heapBytes(const std::pair<A, B> &p) {
+    return heapBytes(p.first) + heapBytes(p.second);
+}
+
+template <typename Container> size_t elementBytes(const Container &c) {
+    size_t total = 0;
+    for (const auto &element : c) {
+        total += heapBytes(element);
+    }
+    return total;
+}
+
+template <typename T> size_t heapBytes(const std::vector<T> &v) {
+    return v.capacity() * sizeof(T) + elementBytes(v);
+}
+
+template <typename T> size_t heapBytes(const std::deque<T> &d) {
+    return d.size() * sizeof(T) + elementBytes(d);
+}
+
+template <typename K, typename C> size_t heapBytes(const std::set<K, C> &s) {
+    return s.size() * (TREE_NODE + sizeof(K)) + elementBytes(s);
+}
+
+template <typename K, typename V, typename C> size_t heapBytes(const std::map<K, V, C> &m) {
+    return m.size() * (TREE_NODE + sizeof(std::pair<const K, V>)) + elementBytes(m);
+}
+
+template <typename K, typename H, typename E> size_t heapBytes(const std::unordered_set<K, H, E> &s) {
+    return s.size() * (HASH_NODE + sizeof(K)) + s.bucket_count() * sizeof(void *) + elementBytes(s);
+}
+
+template <typename K, typename V, typename H, typename E> size_t heapBytes(const std::unordered_map<K, V, H, E> &m) {
+    return m.size() * (HASH_NODE + sizeof(std::pair<const K, V>)) + m.bucket_count() * sizeof(void *) + elementBytes(m);
+}
+
+// Total footprint of a data structure member
+template <typename T> size_t bytes(const T &value) {
+    return sizeof(T) + heapBytes(value);
+}
+
+} // namespace memory
+
+#endif
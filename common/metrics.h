@@ -0,0 +1,21 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <map>
+#include <string>
+
+// Live metrics.
+//
+// Nodes that implement MetricsSource are polled by the MetricsExporter module
+// every sampleInterval. Values are current gauges (table sizes) or running
+// totals (transmissions); the exporter sums them over the network, tracks the
+// maximum node, and publishes the result in Prometheus text format.
+// Metric names are snake_case, e.g. "transmissions", "dedup_entries".
+
+class MetricsSource {
+  public:
+    virtual ~MetricsSource() {}
+    virtual void sampleMetrics(std::map<std::string, double> &metrics) const = 0;
+};
+
+#endif
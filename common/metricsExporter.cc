@@ -0,0 +1,415 @@
+#include <omnetpp.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "memory.h"
+#include "metrics.h"
+
+using namespace omnetpp;
+
+// Samples simulation progress (events, events/sec, event queue length) and the
+// MetricsSource nodes of the network every sampleInterval of simulation time,
+// and publishes the snapshot in Prometheus text format:
+//  - file: rewritten atomically (temp file + rename) on every sample
+//  - listen: "tcp:<port>" (bound to localhost) or "unix:<path>"; a background
+//    thread answers every connection with the latest snapshot, so it can be
+//    scraped by Prometheus or read with curl/nc while the run is going
+// Sampling stops once nothing else is left in the event queue, so the module
+// does not keep a finished simulation alive; the last sample can still move
+// the end time by up to one sampleInterval past the last protocol event.
+//
+// It also accounts the protocol state of MemoryAccountable nodes: bytes per
+// structure, a histogram of per-node totals, and heavy hitters (nodes holding
+// more than heavyHitterFactor times the median). Totals are recorded as
+// vectors on every sample; the histogram and heavy hitters at the end of the
+// run, whether or not sampling is enabled.
+class MetricsExporter : public cSimpleModule {
+  private:
+    cMessage *sampleEvent = nullptr;
+    simtime_t sampleInterval;
+    std::string protocol;
+    std::string file;
+    bool perNode = false;
+
+    // Protocol state, see memory.h
+    struct MemorySample {
+        std::vector<std::pair<std::string, size_t>> nodes; // Node -> bytes of all its structures
+        std::map<std::string, size_t> structures;          // Structure -> bytes over all nodes
+        std::map<std::string, size_t> structureMax;        // Structure -> bytes at the largest node
+        size_t total = 0;
+        size_t median = 0;
+    };
+    double heavyHitterFactor = 4;
+    std::set<std::string> heavyHitters;                     // Flagged so far, warned about once
+    cOutVector stateBytesVector;
+    cOutVector maxStateBytesVector;
+    cOutVector heavyHittersVector;
+
+    std::chrono::steady_clock::time_point startWallTime;
+    std::chrono::steady_clock::time_point lastWallTime;
+    eventnumber_t lastEventNumber = 0;
+
+    // Server thread state; the snapshot is the only data shared with it
+    std::string unixPath;
+    int listenFd = -1;
+    std::thread server;
+    std::atomic<bool> stopping{false};
+    std::mutex snapshotMutex;
+    std::string snapshot;
+
+  protected:
+    virtual int numInitStages() const override { return 2; }
+    virtual void initialize(int stage) override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+    void scheduleSample();
+    void sample();
+    void publish(const std::string &text);
+    MemorySample accountMemory();
+    bool isHeavyHitter(size_t bytes, const MemorySample &memory);
+    void sampleMemory(std::ostream &out, const std::string &labels);
+    void startServer(const std::string &listen);
+    void stopServer();
+    void serve();
+
+  public:
+    virtual ~MetricsExporter();
+};
+
+Define_Module(MetricsExporter);
+
+MetricsExporter::~MetricsExporter() {
+    cancelAndDelete(sampleEvent);
+    stopServer();
+}
+
+void MetricsExporter::initialize(int stage) {
+    if (stage == 1) {
+        scheduleSample(); // Once the other modules queued their first events
+        return;
+    }
+
+    sampleInterval = par("sampleInterval").doubleValue();
+    protocol = par("protocol").stdstringValue();
+    file = par("file").stdstringValue();
+    perNode = par("perNode");
+    heavyHitterFactor = par("heavyHitterFactor");
+
+    stateBytesVector.setName("stateBytes");
+    maxStateBytesVector.setName("maxNodeStateBytes");
+    heavyHittersVector.setName("heavyHitters");
+
+    startWallTime = lastWallTime = std::chrono::steady_clock::now();
+
+    if (sampleInterval <= 0) {
+        return; // Disabled
+    }
+    startServer(par("listen").stdstringValue());
+    sampleEvent = new cMessage("SampleMetrics");
+    sampleEvent->setSchedulingPriority(SHRT_MAX); // After everything else due at the same time
+}
+
+void MetricsExporter::handleMessage(cMessage *msg) {
+    sample();
+    scheduleSample();
+}
+
+// Next sample sampleInterval from now; none if the other modules have
+// nothing queued. sampleEvent is not scheduled here, so any queued event is
+// theirs and the check is O(1) instead of a scan of the event queue.
+void MetricsExporter::scheduleSample() {
+    if (sampleEvent == nullptr) {
+        return; // Disabled
+    }
+    if (getSimulation()->getFES()->getLength() > 0) {
+        scheduleAt(simTime() + sampleInterval, sampleEvent);
+    }
+}
+
+void MetricsExporter::sample() {
+    auto now = std::chrono::steady_clock::now();
+    eventnumber_t events = getSimulation()->getEventNumber();
+    double wallSeconds = std::chrono::duration<double>(now - lastWallTime).count();
+    double eventsPerSecond = wallSeconds > 0 ? (events - lastEventNumber) / wallSeconds : 0;
+    lastWallTime = now;
+    lastEventNumber = events;
+
+    std::ostringstream out;
+    std::string labels = "protocol=\"" + protocol + "\"";
+    out << "# TYPE sim_time_seconds gauge\nsim_time_seconds{" << labels << "} " << SIMTIME_DBL(simTime()) << "\n"
+        << "# TYPE sim_wall_seconds gauge\nsim_wall_seconds{" << labels << "} "
+        << std::chrono::duration<double>(now - startWallTime).count() << "\n"
+        << "# TYPE sim_events_total counter\nsim_events_total{" << labels << "} " << events << "\n"
+        << "# TYPE sim_events_per_second gauge\nsim_events_per_second{" << labels << "} " << eventsPerSecond << "\n"
+        << "# TYPE sim_event_queue_length gauge\nsim_event_queue_length{" << labels << "} "
+        << getSimulation()->getFES()->getLength() << "\n";
+
+    // Sum and maximum over the nodes, optionally every node's own value
+    std::map<std::string, double> totals, maxima;
+    std::map<std::string, std::ostringstream> nodeLines;
+    int nodes = 0;
+    for (cModule::SubmoduleIterator it(getParentModule()); !it.end(); ++it) {
+        MetricsSource *node = dynamic_cast<MetricsSource *>(*it);
+        if (node == nullptr) {
+            continue;
+        }
+        std::map<std::string, double> values;
+        node->sampleMetrics(values);
+        for (const auto &value : values) {
+            totals[value.first] += value.second;
+            auto max = maxima.find(value.first);
+            if (max == maxima.end() || value.second > max->second) {
+                maxima[value.first] = value.second;
+            }
+            if (perNode) {
+                nodeLines[value.first] << "sim_node_" << value.first << "{" << labels << ",node=\""
+                                       << (*it)->getFullName() << "\"} " << value.second << "\n";
+            }
+        }
+        nodes++;
+    }
+
+    out << "# TYPE sim_nodes gauge\nsim_nodes{" << labels << "} " << nodes << "\n";
+    for (const auto &total : totals) {
+        const std::string &name = total.first;
+        out << "# TYPE sim_node_" << name << " gauge\n"
+            << "sim_node_" << name << "{" << labels << ",stat=\"sum\"} " << total.second << "\n"
+            << "sim_node_" << name << "{" << labels << ",stat=\"max\"} " << maxima[name] << "\n"
+            << nodeLines[name].str();
+    }
+
+    sampleMemory(out, labels);
+    publish(out.str());
+}
+
+MetricsExporter::MemorySample MetricsExporter::accountMemory() {
+    MemorySample memory;
+    for (cModule::SubmoduleIterator it(getParentModule()); !it.end(); ++it) {
+        MemoryAccountable *node = dynamic_cast<MemoryAccountable *>(*it);
+        if (node == nullptr) {
+            continue;
+        }
+        std::map<std::string, size_t> bytes;
+        node->reportMemory(bytes);
+
+        size_t nodeTotal = 0;
+        for (const auto &structure : bytes) {
+            memory.structures[structure.first] += structure.second;
+            memory.structureMax[structure.first] = std::max(memory.structureMax[structure.first], structure.second);
+            nodeTotal += structure.second;
+        }
+        memory.nodes.push_back(std::make_pair(std::string((*it)->getFullName()), nodeTotal));
+        memory.total += nodeTotal;
+    }
+
+    if (!memory.nodes.empty()) {
+        std::vector<size_t> totals;
+        for (const auto &node : memory.nodes) {
+            totals.push_back(node.second);
+        }
+        std::nth_element(totals.begin(), totals.begin() + totals.size() / 2, totals.end());
+        memory.median = totals[totals.size() / 2];
+    }
+    return memory;
+}
+
+bool MetricsExporter::isHeavyHitter(size_t bytes, const MemorySample &memory) {
+    return heavyHitterFactor > 0 && bytes > heavyHitterFactor * memory.median;
+}
+
+void MetricsExporter::sampleMemory(std::ostream &out, const std::string &labels) {
+    MemorySample memory = accountMemory();
+    if (memory.nodes.empty()) {
+        return;
+    }
+
+    out << "# TYPE sim_state_bytes gauge\n";
+    for (const auto &structure : memory.structures) {
+        out << "sim_state_bytes{" << labels << ",structure=\"" << structure.first << "\",stat=\"sum\"} "
+            << structure.second << "\n"
+            << "sim_state_bytes{" << labels << ",structure=\"" << structure.first << "\",stat=\"max\"} "
+            << memory.structureMax[structure.first] << "\n";
+    }
+
+    // Per-node totals in power-of-4 buckets, Prometheus histogram layout
+    size_t largest = 0;
+    for (const auto &node : memory.nodes) {
+        largest = std::max(largest, node.second);
+    }
+    out << "# TYPE sim_node_state_bytes histogram\n";
+    for (size_t bound = 256;; bound *= 4) {
+        size_t count = 0;
+        for (const auto &node : memory.nodes) {
+            count += node.second <= bound;
+        }
+        out << "sim_node_state_bytes_bucket{" << labels << ",le=\"" << bound << "\"} " << count << "\n";
+        if (bound >= largest) {
+            break;
+        }
+    }
+    out << "sim_node_state_bytes_bucket{" << labels << ",le=\"+Inf\"} " << memory.nodes.size() << "\n"
+        << "sim_node_state_bytes_sum{" << labels << "} " << memory.total << "\n"
+        << "sim_node_state_bytes_count{" << labels << "} " << memory.nodes.size() << "\n";
+
+    out << "# TYPE sim_heavy_hitter_bytes gauge\n";
+    int flagged = 0;
+    for (const auto &node : memory.nodes) {
+        if (!isHeavyHitter(node.second, memory)) {
+            continue;
+        }
+        flagged++;
+        out << "sim_heavy_hitter_bytes{" << labels << ",node=\"" << node.first << "\"} " << node.second << "\n";
+        if (heavyHitters.insert(node.first).second) {
+            EV_WARN << node.first << " holds " << node.second << " bytes of protocol state, median is "
+                    << memory.median << " bytes\n";
+        }
+    }
+
+    stateBytesVector.record(memory.total);
+    maxStateBytesVector.record(largest);
+    heavyHittersVector.record(flagged);
+}
+
+void MetricsExporter::publish(const std::string &text) {
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        snapshot = text;
+    }
+
+    if (!file.empty()) {
+        std::string temp = file + ".tmp";
+        std::ofstream(temp, std::ios::trunc) << text;
+        if (std::rename(temp.c_str(), file.c_str()) != 0) {
+            throw cRuntimeError("Cannot write metrics file '%s'", file.c_str());
+        }
+    }
+}
+
+void MetricsExporter::startServer(const std::string &listen) {
+    if (listen.empty()) {
+        return;
+    }
+
+    if (listen.compare(0, 4, "tcp:") == 0) {
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(std::stoi(listen.substr(4)));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+            close(listenFd);
+            listenFd = -1;
+        }
+    } else if (listen.compare(0, 5, "unix:") == 0) {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        unixPath = listen.substr(5);
+        strncpy(addr.sun_path, unixPath.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(unixPath.c_str());
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+            close(listenFd);
+            listenFd = -1;
+        }
+    } else {
+        throw cRuntimeError("Bad listen address '%s', expected \"tcp:<port>\" or \"unix:<path>\"", listen.c_str());
+    }
+
+    if (listenFd < 0 || ::listen(listenFd, 8) != 0) {
+        throw cRuntimeError("Cannot listen on '%s': %s", listen.c_str(), strerror(errno));
+    }
+    server = std::thread(&MetricsExporter::serve, this);
+}
+
+void MetricsExporter::stopServer() {
+    stopping = true;
+    if (server.joinable()) {
+        server.join();
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+    }
+    if (!unixPath.empty()) {
+        unlink(unixPath.c_str());
+        unixPath.clear();
+    }
+}
+
+// Runs on the server thread: answer each connection with the latest snapshot.
+// The request itself (usually an HTTP GET from a scraper) is not parsed.
+void MetricsExporter::serve() {
+    while (!stopping) {
+        pollfd listening = {listenFd, POLLIN, 0};
+        if (poll(&listening, 1, 200) <= 0) {
+            continue;
+        }
+        int client = accept(listenFd, nullptr, nullptr);
+        if (client < 0) {
+            continue;
+        }
+
+        pollfd request = {client, POLLIN, 0};
+        char buffer[1024];
+        if (poll(&request, 1, 100) > 0) {
+            ::recv(client, buffer, sizeof(buffer), 0);
+        }
+
+        std::string response;
+        {
+            std::lock_guard<std::mutex> lock(snapshotMutex);
+            response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n" + snapshot;
+        }
+        for (size_t sent = 0; sent < response.size();) {
+            ssize_t n = ::send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                break;
+            }
+            sent += n;
+        }
+        close(client);
+    }
+}
+
+void MetricsExporter::finish() {
+    if (sampleInterval > 0) {
+        sample(); // Final values, e.g. for the file after the run
+    }
+    stopServer();
+
+    MemorySample memory = accountMemory();
+    if (memory.nodes.empty()) {
+        return;
+    }
+    cHistogram stateHistogram("nodeStateBytes");
+    for (const auto &node : memory.nodes) {
+        stateHistogram.collect(node.second);
+        if (isHeavyHitter(node.second, memory)) {
+            recordScalar(("heavyHitter-" + node.first).c_str(), node.second);
+        }
+    }
+    recordStatistic(&stateHistogram);
+    for (const auto &structure : memory.structures) {
+        recordScalar(("stateBytes-" + structure.first).c_str(), structure.second);
+    }
+}
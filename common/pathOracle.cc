@@ -0,0 +1,196 @@
+#include <omnetpp.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "pathOracle.h"
+
+using namespace omnetpp;
+
+Define_Module(PathOracle);
+
+static const int UNREACHABLE = -1;
+
+void PathOracle::initialize() {
+    hopDelay = par("hopDelay");
+    routeStretch.setName("routeStretch");
+    routeStretchVector.setName("routeStretch");
+    latencyStretch.setName("latencyStretch");
+
+    int numThreads = par("threads");
+    if (numThreads <= 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    buildGraph();
+    computeDistances(numThreads);
+    EV << "PathOracle: " << numNodes << " nodes, " << edges.size() << " links, "
+       << (wide ? 16 : 8) << "-bit distances\n";
+}
+
+PathOracle *PathOracle::find(cModule *node) {
+    for (cModule::SubmoduleIterator it(node->getParentModule()); !it.end(); ++it) {
+        PathOracle *oracle = dynamic_cast<PathOracle *>(*it);
+        if (oracle != nullptr) {
+            return oracle;
+        }
+    }
+    return nullptr;
+}
+
+void PathOracle::buildGraph() {
+    std::vector<cModule *> modules;
+    for (cModule::SubmoduleIterator it(getParentModule()); !it.end(); ++it) {
+        if ((*it)->hasGate("io")) {
+            ids[(*it)->getFullName()] = modules.size();
+            names.push_back((*it)->getFullName());
+            modules.push_back(*it);
+        }
+    }
+    numNodes = modules.size();
+
+    offsets.assign(numNodes + 1, 0);
+    for (int v = 0; v < numNodes; ++v) {
+        for (cModule::GateIterator git(modules[v]); !git.end(); ++git) {
+            cGate *out = *git;
+            if (out->getType() != cGate::OUTPUT || out->getNextGate() == nullptr) {
+                continue;
+            }
+            auto neighbor = ids.find(out->getNextGate()->getOwnerModule()->getFullName());
+            if (neighbor != ids.end()) {
+                edges.push_back(neighbor->second);
+            }
+        }
+        offsets[v + 1] = edges.size();
+    }
+}
+
+// Upper bound of the diameter from one BFS: twice the eccentricity of node 0
+int PathOracle::diameterBound() {
+    if (numNodes == 0) {
+        return 0;
+    }
+    std::vector<int> dist, queue;
+    bfs(0, dist, queue);
+    return 2 * *std::max_element(dist.begin(), dist.end());
+}
+
+void PathOracle::bfs(int origin, std::vector<int> &dist, std::vector<int> &queue) {
+    dist.assign(numNodes, UNREACHABLE);
+    queue.clear();
+    dist[origin] = 0;
+    queue.push_back(origin);
+    for (size_t head = 0; head < queue.size(); ++head) {
+        int v = queue[head];
+        for (int e = offsets[v]; e < offsets[v + 1]; ++e) {
+            if (dist[edges[e]] == UNREACHABLE) {
+                dist[edges[e]] = dist[v] + 1;
+                queue.push_back(edges[e]);
+            }
+        }
+    }
+}
+
+// One BFS per origin, origins handed out to the threads dynamically. Every
+// row of the table is written by exactly one thread.
+void PathOracle::computeDistances(int numThreads) {
+    int bits = par("distanceBits");
+    if (bits == 0) {
+        bits = diameterBound() < UINT8_MAX ? 8 : 16;
+    }
+    if (bits != 8 && bits != 16) {
+        throw cRuntimeError("distanceBits must be 0, 8 or 16");
+    }
+    wide = bits == 16;
+    size_t cells = (size_t)numNodes * numNodes;
+    if (wide) {
+        distances16.assign(cells, UINT16_MAX);
+    } else {
+        distances8.assign(cells, UINT8_MAX);
+    }
+
+    std::atomic<int> next(0);
+    std::atomic<bool> overflow(false);
+    auto worker = [&]() {
+        std::vector<int> dist, queue;
+        for (int origin = next++; origin < numNodes; origin = next++) {
+            bfs(origin, dist, queue);
+            size_t row = (size_t)origin * numNodes;
+            for (int v = 0; v < numNodes; ++v) {
+                if (dist[v] == UNREACHABLE) {
+                    continue;
+                }
+                if (dist[v] >= (wide ? UINT16_MAX : UINT8_MAX)) {
+                    overflow = true;
+                } else if (wide) {
+                    distances16[row + v] = dist[v];
+                } else {
+                    distances8[row + v] = dist[v];
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < numThreads; ++t) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    if (overflow) {
+        throw cRuntimeError("Hop distances do not fit in %d bits, set distanceBits = 16", bits);
+    }
+}
+
+int PathOracle::distance(const std::string &from, const std::string &to) const {
+    auto a = ids.find(from);
+    auto b = ids.find(to);
+    if (a == ids.end() || b == ids.end()) {
+        return UNREACHABLE;
+    }
+    size_t cell = (size_t)a->second * numNodes + b->second;
+    int d = wide ? distances16[cell] : distances8[cell];
+    return d == (wide ? UINT16_MAX : UINT8_MAX) ? UNREACHABLE : d;
+}
+
+void PathOracle::recordRoute(const std::string &from, const std::string &to, int hops) {
+    Enter_Method_Silent();
+
+    int optimal = distance(from, to);
+    if (optimal <= 0) {
+        return;
+    }
+    double stretch = (double)hops / optimal;
+    routeStretch.collect(stretch);
+    routeStretchVector.record(stretch);
+    optimalRoutes += hops == optimal;
+}
+
+void PathOracle::recordBroadcast(long broadcastId, const std::string &origin, const std::string &receiver, simtime_t latency) {
+    Enter_Method_Silent();
+
+    int optimal = distance(origin, receiver);
+    if (optimal <= 0) {
+        return;
+    }
+    double stretch = SIMTIME_DBL(latency) / (optimal * hopDelay);
+    latencyStretch.collect(stretch);
+    broadcastStretch[broadcastId].collect(stretch);
+}
+
+void PathOracle::finish() {
+    if (routeStretch.getCount() > 0) {
+        recordStatistic(&routeStretch);
+        recordScalar("optimalRouteFraction", (double)optimalRoutes / routeStretch.getCount());
+    }
+    if (latencyStretch.getCount() > 0) {
+        recordStatistic(&latencyStretch);
+    }
+    for (const auto &entry : broadcastStretch) {
+        std::string id = std::to_string(entry.first);
+        recordScalar(("latencyStretch-" + id).c_str(), entry.second.getMean());
+        recordScalar(("maxLatencyStretch-" + id).c_str(), entry.second.getMax());
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef PATHORACLE_H
+#define PATHORACLE_H
+
+#include <omnetpp.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace omnetpp;
+
+// Shortest-path oracle.
+//
+// At startup it builds a CSR graph of the network's nodes (submodules with an
+// "io" gate) from their connections and runs a BFS from every node on several
+// threads. Hop distances are kept in an n x n table of 8-bit entries when the
+// diameter allows it, 16-bit otherwise.
+//
+// Nodes report what they observed and the oracle scores it against the
+// optimum:
+//  - route stretch: hops a unicast packet travelled / shortest distance
+//  - latency stretch: first-arrival delay of a broadcast at a receiver /
+//    (shortest distance * hopDelay)
+// Stretch 1 is optimal.
+
+class PathOracle : public cSimpleModule {
+  private:
+    std::map<std::string, int> ids;
+    std::vector<std::string> names;
+    std::vector<int> offsets, edges;        // CSR adjacency
+    int numNodes = 0;
+
+    bool wide = false;                      // 16-bit instead of 8-bit distances
+    std::vector<uint8_t> distances8;
+    std::vector<uint16_t> distances16;
+
+    double hopDelay = 1;
+    cHistogram routeStretch;
+    cOutVector routeStretchVector;
+    long optimalRoutes = 0;
+    cHistogram latencyStretch;
+    std::map<long, cStdDev> broadcastStretch;   // Broadcast ID -> stretch at its receivers
+
+  protected:
+    virtual void initialize() override;
+    virtual void finish() override;
+
+    void buildGraph();
+    void computeDistances(int numThreads);
+    void bfs(int origin, std::vector<int> &dist, std::vector<int> &queue);
+    int diameterBound();
+
+  public:
+    // The oracle of the network a node belongs to, nullptr if there is none
+    static PathOracle *find(cModule *node);
+
+    // Hop distance, -1 if unknown or unreachable
+    int distance(const std::string &from, const std::string &to) const;
+
+    void recordRoute(const std::string &from, const std::string &to, int hops);
+    void recordBroadcast(long broadcastId, const std::string &origin, const std::string &receiver, simtime_t latency);
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include <omnetpp.h>
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <string>
+
+using namespace omnetpp;
+
+// Scoped broadcast.
+//
+// The source can bound how far a broadcast travels with two message
+// parameters, both optional:
+//  - "ttl": hops the broadcast may still travel. Every receiver takes one
+//    hop off and forwards only while some are left, so the broadcast reaches
+//    the nodes within hopLimit hops of the source.
+//  - "scopeBox": "x1 y1 x2 y2" in display coordinates. Copies are only sent
+//    to neighbors whose @display position lies inside the box; nodes without
+//    a position count as inside.
+// Out-of-scope copies are never sent, so they cost no events downstream.
+
+namespace scope {
+
+// Source side: hopLimit <= 0 and an empty box mean unbounded
+inline void stamp(cMessage *msg, int hopLimit, const std::string &box) {
+    if (hopLimit > 0) {
+        msg->addPar("ttl") = hopLimit;
+    }
+    if (!box.empty()) {
+        msg->addPar("scopeBox") = box.c_str();
+    }
+}
+
+// Receiver side: consume one hop, true if the broadcast may travel further
+inline bool consumeHop(cMessage *msg) {
+    if (!msg->hasPar("ttl")) {
+        return true;
+    }
+    long ttl = msg->par("ttl").intValue() - 1;
+    msg->par("ttl") = ttl;
+    return ttl > 0;
+}
+
+inline bool inBox(const std::string &box, cModule *node) {
+    if (box.empty()) {
+        return true;
+    }
+
+    double x1, y1, x2, y2;
+    std::stringstream ss(box);
+    if (!(ss >> x1 >> y1 >> x2 >> y2)) {
+        throw cRuntimeError("Bad scopeBox '%s', expected \"x1 y1 x2 y2\"", box.c_str());
+    }
+
+    const char *x = node->getDisplayString().getTagArg("p", 0);
+    const char *y = node->getDisplayString().getTagArg("p", 1);
+    if (*x == '\0' || *y == '\0') {
+        return true;
+    }
+    double px = atof(x), py = atof(y);
+    return std::min(x1, x2) <= px && px <= std::max(x1, x2)
+        && std::min(y1, y2) <= py && py <= std::max(y1, y2);
+}
+
+inline bool inBox(cMessage *msg, cModule *node) {
+    return !msg->hasPar("scopeBox") || inBox(msg->par("scopeBox").stdstringValue(), node);
+}
+
+// Nodes a broadcast of source can reach within its scope: connected to the
+// source through in-box nodes only, at most hopLimit hops away. Used as the
+// delivery ratio denominator, so out-of-scope nodes do not count as misses.
+inline int receivers(cModule *source, int hopLimit, const std::string &box) {
+    std::map<cModule *, int> hops; // Reached node -> hops from the source
+    std::deque<cModule *> frontier;
+    hops[source] = 0;
+    frontier.push_back(source);
+
+    while (!frontier.empty()) {
+        cModule *node = frontier.front();
+        frontier.pop_front();
+        if (hopLimit > 0 && hops[node] >= hopLimit) {
+            continue;
+        }
+        for (cModule::GateIterator it(node); !it.end(); ++it) {
+            cGate *out = *it;
+            if (out->getType() != cGate::OUTPUT || out->getNextGate() == nullptr) {
+                continue;
+            }
+            cModule *neighbor = out->getNextGate()->getOwnerModule();
+            if (hops.count(neighbor) == 0 && neighbor->hasGate("io") && inBox(box, neighbor)) {
+                hops[neighbor] = hops[node] + 1;
+                frontier.push_back(neighbor);
+            }
+        }
+    }
+    return hops.size() - 1;
+}
+
+} // namespace scope
+
+#endif
@@ -0,0 +1,434 @@
+// Analytical flooding engine.
+//
+// With a fixed delay of 1 per link, plain flooding (see ../flooding) reaches
+// every node at its hop distance from the origin, and each node that forwards
+// sends one copy on every link except the one towards the node it first heard
+// the broadcast from. Reach, latency and transmission count therefore follow
+// from a BFS over the topology; no event simulation is needed.
+//
+// The topology is read from a NED file (submodules + connections of the
+// network) or from an edge list ("u v" per line), stored in CSR form, and a
+// direction-optimizing BFS is run from every origin on several threads.
+//
+// Usage:
+//   floodEngine [options] <topology.ned | edges.txt>
+//     -t <n>          number of worker threads (default: hardware threads)
+//     -o <name>       only run from this origin and print per-node results
+//     -s              only run from source modules (type name contains "Source")
+//     -d              treat edge-list lines as directed links
+//     -c <file.sca>   cross-check against the scalars of a flooding run
+//     -n <n>          broadcasts in that run (default 10, see BidirectionalSourceNode)
+//
+// The cross-check against the simulator on RandomNetwork2 runs as part of the
+// regression checks (python checks.py flood-engine, from the repository root),
+// which run the flooding simulation and then:
+//   floodEngine -c flooding/results/RandomNetwork2-#0.sca flooding/RandomNetwork2.ned
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+struct Graph {
+    std::vector<std::string> names;
+    std::vector<char> forwards;             // Leaf and source modules only receive
+    std::vector<char> isSource;             // Modules that inject broadcasts
+    std::vector<int> outOffset, outEdges;   // CSR: outgoing links
+    std::vector<int> inOffset, inEdges;     // CSR: incoming links, used by bottom-up steps
+
+    int numNodes() const { return names.size(); }
+    int outDegree(int v) const { return outOffset[v + 1] - outOffset[v]; }
+};
+
+struct FloodResult {
+    int reach = 0;              // Nodes reached, origin excluded
+    long transmissions = 0;     // Copies sent, origin included
+    int maxLatency = 0;
+    double meanLatency = 0;
+};
+
+class GraphBuilder {
+  private:
+    std::map<std::string, int> ids;
+    std::vector<std::pair<int, int>> links;
+    Graph graph;
+
+  public:
+    int addNode(const std::string &name, const std::string &type) {
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        int id = graph.names.size();
+        ids[name] = id;
+        graph.names.push_back(name);
+        graph.forwards.push_back(type.find("Leaf") == std::string::npos && type.find("Source") == std::string::npos);
+        graph.isSource.push_back(type.find("Source") != std::string::npos);
+        return id;
+    }
+
+    void addLink(const std::string &from, const std::string &to) {
+        links.push_back(std::make_pair(addNode(from, ""), addNode(to, "")));
+    }
+
+    Graph build() {
+        int n = graph.names.size();
+        graph.outOffset.assign(n + 1, 0);
+        graph.inOffset.assign(n + 1, 0);
+        for (const auto &link : links) {
+            graph.outOffset[link.first + 1]++;
+            graph.inOffset[link.second + 1]++;
+        }
+        for (int v = 0; v < n; ++v) {
+            graph.outOffset[v + 1] += graph.outOffset[v];
+            graph.inOffset[v + 1] += graph.inOffset[v];
+        }
+        graph.outEdges.resize(links.size());
+        graph.inEdges.resize(links.size());
+        std::vector<int> outPos(graph.outOffset.begin(), graph.outOffset.end() - 1);
+        std::vector<int> inPos(graph.inOffset.begin(), graph.inOffset.end() - 1);
+        for (const auto &link : links) {
+            graph.outEdges[outPos[link.first]++] = link.second;
+            graph.inEdges[inPos[link.second]++] = link.first;
+        }
+        return graph;
+    }
+};
+
+// Read the submodules and connections of the network defined in a NED file
+static bool loadNed(const std::string &fileName, GraphBuilder &builder) {
+    std::ifstream in(fileName);
+    if (!in) {
+        return false;
+    }
+
+    std::regex submodule(R"(^\s*(\w+)\s*:\s*(\w+)\s*[;{])");
+    std::regex connection(R"((\w+)\.\w+(?:\+\+|\[\d+\])?\s*(<-->|-->|<--)\s*(?:\w+\s*(?:<-->|-->|<--)\s*)?(\w+)\.\w+)");
+    enum { OUTSIDE, SUBMODULES, CONNECTIONS } section = OUTSIDE;
+    bool inNetwork = false;
+
+    // Submodules become nodes only if they are connected, so helper modules
+    // without gates (e.g. the metrics exporter) stay out of the graph
+    std::vector<std::pair<std::string, std::string>> submodules;
+    std::vector<std::pair<std::string, std::string>> links;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find("//"));
+        std::smatch m;
+        if (line.find("network ") == 0) {
+            inNetwork = true;
+            section = OUTSIDE;
+        } else if (!inNetwork) {
+            continue;
+        } else if (line.find("submodules:") != std::string::npos) {
+            section = SUBMODULES;
+        } else if (line.find("connections") != std::string::npos) {
+            section = CONNECTIONS;
+        } else if (section == SUBMODULES && std::regex_search(line, m, submodule)) {
+            submodules.push_back(std::make_pair(m[1], m[2]));
+        } else if (section == CONNECTIONS && std::regex_search(line, m, connection)) {
+            if (m[2] != "<--") {
+                links.push_back(std::make_pair(m[1], m[3]));
+            }
+            if (m[2] != "-->") {
+                links.push_back(std::make_pair(m[3], m[1]));
+            }
+        }
+    }
+
+    std::set<std::string> connected;
+    for (const auto &link : links) {
+        connected.insert(link.first);
+        connected.insert(link.second);
+    }
+    for (const auto &module : submodules) {
+        if (connected.count(module.first) > 0) {
+            builder.addNode(module.first, module.second);
+        }
+    }
+    for (const auto &link : links) {
+        builder.addLink(link.first, link.second);
+    }
+    return true;
+}
+
+// Read "u v" pairs, one link per line; '#' starts a comment
+static bool loadEdgeList(const std::string &fileName, bool directed, GraphBuilder &builder) {
+    std::ifstream in(fileName);
+    if (!in) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::stringstream ss(line.substr(0, line.find('#')));
+        std::string u, v;
+        if (!(ss >> u >> v)) {
+            continue;
+        }
+        builder.addLink(u, v);
+        if (!directed) {
+            builder.addLink(v, u);
+        }
+    }
+    return true;
+}
+
+static bool hasLink(const Graph &g, int from, int to) {
+    for (int e = g.outOffset[from]; e < g.outOffset[from + 1]; ++e) {
+        if (g.outEdges[e] == to) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Direction-optimizing BFS (top-down while the frontier is small, bottom-up
+// while it is large). Only the origin and forwarding nodes expand the frontier.
+// dist and parent are per-thread scratch buffers of size numNodes().
+static FloodResult flood(const Graph &g, int origin, std::vector<int> &dist, std::vector<int> &parent) {
+    const int alpha = 15, beta = 18;
+    int n = g.numNodes();
+
+    std::fill(dist.begin(), dist.end(), -1);
+    std::fill(parent.begin(), parent.end(), -1);
+    dist[origin] = 0;
+
+    std::vector<int> frontier(1, origin), next;
+    long unexploredEdges = g.outEdges.size();
+    bool bottomUp = false;
+
+    for (int level = 0; !frontier.empty(); ++level) {
+        long frontierEdges = 0;
+        for (int u : frontier) {
+            frontierEdges += g.outDegree(u);
+        }
+        unexploredEdges -= frontierEdges;
+
+        if (!bottomUp && frontierEdges > unexploredEdges / alpha) {
+            bottomUp = true;
+        } else if (bottomUp && (long)frontier.size() < n / beta) {
+            bottomUp = false;
+        }
+
+        next.clear();
+        if (bottomUp) {
+            for (int v = 0; v < n; ++v) {
+                if (dist[v] >= 0) {
+                    continue;
+                }
+                for (int e = g.inOffset[v]; e < g.inOffset[v + 1]; ++e) {
+                    int u = g.inEdges[e];
+                    if (dist[u] == level && (g.forwards[u] || u == origin)) {
+                        dist[v] = level + 1;
+                        parent[v] = u;
+                        next.push_back(v);
+                        break;
+                    }
+                }
+            }
+        } else {
+            for (int u : frontier) {
+                if (!g.forwards[u] && u != origin) {
+                    continue;
+                }
+                for (int e = g.outOffset[u]; e < g.outOffset[u + 1]; ++e) {
+                    int v = g.outEdges[e];
+                    if (dist[v] < 0) {
+                        dist[v] = level + 1;
+                        parent[v] = u;
+                        next.push_back(v);
+                    }
+                }
+            }
+        }
+        frontier.swap(next);
+    }
+
+    FloodResult result;
+    long latencySum = 0;
+    result.transmissions = g.outDegree(origin);
+    for (int v = 0; v < n; ++v) {
+        if (v == origin || dist[v] < 0) {
+            continue;
+        }
+        result.reach++;
+        result.maxLatency = std::max(result.maxLatency, dist[v]);
+        latencySum += dist[v];
+        if (g.forwards[v]) {
+            result.transmissions += g.outDegree(v) - (hasLink(g, v, parent[v]) ? 1 : 0);
+        }
+    }
+    result.meanLatency = result.reach > 0 ? (double)latencySum / result.reach : 0;
+    return result;
+}
+
+// Flood from every origin, distributing origins over the worker threads
+static std::vector<FloodResult> floodAll(const Graph &g, const std::vector<int> &origins, int numThreads) {
+    std::vector<FloodResult> results(origins.size());
+    std::atomic<size_t> nextOrigin(0);
+
+    auto worker = [&]() {
+        std::vector<int> dist(g.numNodes()), parent(g.numNodes());
+        for (size_t i = nextOrigin++; i < origins.size(); i = nextOrigin++) {
+            results[i] = flood(g, origins[i], dist, parent);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back(worker);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    return results;
+}
+
+// Compare against the scalars recorded by the flooding project's nodes.
+// Every node sees the same flood once per broadcast.
+static int crossCheck(const Graph &g, int origin, const std::string &scaFile, int numBroadcasts) {
+    std::ifstream in(scaFile);
+    if (!in) {
+        std::cerr << "Cannot open " << scaFile << "\n";
+        return 2;
+    }
+
+    std::vector<int> dist(g.numNodes()), parent(g.numNodes());
+    flood(g, origin, dist, parent);
+
+    std::map<std::string, int> ids;
+    for (int v = 0; v < g.numNodes(); ++v) {
+        ids[g.names[v]] = v;
+    }
+
+    int compared = 0, mismatches = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::stringstream ss(line);
+        std::string keyword, module, name;
+        double value;
+        if (!(ss >> keyword >> module >> name >> value) || keyword != "scalar") {
+            continue;
+        }
+        auto it = ids.find(module.substr(module.rfind('.') + 1));
+        if (it == ids.end()) {
+            continue;
+        }
+
+        int v = it->second;
+        double expected;
+        if (name == "transmissions") {
+            expected = (g.forwards[v] && dist[v] > 0) ? (double)numBroadcasts * (g.outDegree(v) - (hasLink(g, v, parent[v]) ? 1 : 0)) : 0;
+        } else if (name == "broadcastsReceived") {
+            expected = dist[v] > 0 ? numBroadcasts : 0;
+        } else if (name == "meanLatency") {
+            expected = dist[v];
+        } else {
+            continue;
+        }
+
+        compared++;
+        if (std::fabs(expected - value) > 1e-9) {
+            mismatches++;
+            std::cout << "MISMATCH " << module << " " << name << ": simulated " << value << ", analytical " << expected << "\n";
+        }
+    }
+
+    std::cout << "Compared " << compared << " scalars, " << mismatches << " mismatches.\n";
+    return (compared == 0 || mismatches > 0) ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::string originName, scaFile;
+    bool sourcesOnly = false, directed = false;
+    int numBroadcasts = 10;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:o:sdc:n:")) != -1) {
+        switch (opt) {
+            case 't': numThreads = std::max(1, atoi(optarg)); break;
+            case 'o': originName = optarg; break;
+            case 's': sourcesOnly = true; break;
+            case 'd': directed = true; break;
+            case 'c': scaFile = optarg; break;
+            case 'n': numBroadcasts = atoi(optarg); break;
+            default:
+                std::cerr << "Usage: " << argv[0] << " [-t threads] [-o origin] [-s] [-d] [-c file.sca] [-n broadcasts] <topology>\n";
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        std::cerr << "Missing topology file\n";
+        return 2;
+    }
+
+    std::string fileName = argv[optind];
+    GraphBuilder builder;
+    bool isNed = fileName.size() > 4 && fileName.compare(fileName.size() - 4, 4, ".ned") == 0;
+    if (!(isNed ? loadNed(fileName, builder) : loadEdgeList(fileName, directed, builder))) {
+        std::cerr << "Cannot open " << fileName << "\n";
+        return 2;
+    }
+    Graph g = builder.build();
+
+    if (!scaFile.empty() && originName.empty()) {
+        originName = "source";
+    }
+
+    if (!originName.empty()) {
+        int origin = std::find(g.names.begin(), g.names.end(), originName) - g.names.begin();
+        if (origin == g.numNodes()) {
+            std::cerr << "Unknown origin " << originName << "\n";
+            return 2;
+        }
+        if (!scaFile.empty()) {
+            return crossCheck(g, origin, scaFile, numBroadcasts);
+        }
+
+        // Per-node view of a single flood
+        std::vector<int> dist(g.numNodes()), parent(g.numNodes());
+        FloodResult result = flood(g, origin, dist, parent);
+        std::cout << "node,firstArrival,transmissions\n";
+        for (int v = 0; v < g.numNodes(); ++v) {
+            int sent = 0;
+            if (v == origin) {
+                sent = g.outDegree(v);
+            } else if (dist[v] > 0 && g.forwards[v]) {
+                sent = g.outDegree(v) - (hasLink(g, v, parent[v]) ? 1 : 0);
+            }
+            std::cout << g.names[v] << "," << dist[v] << "," << sent << "\n";
+        }
+        std::cout << "# reach " << result.reach << ", transmissions " << result.transmissions
+                  << ", max latency " << result.maxLatency << ", mean latency " << result.meanLatency << "\n";
+        return 0;
+    }
+
+    std::vector<int> origins;
+    for (int v = 0; v < g.numNodes(); ++v) {
+        if (!sourcesOnly || g.isSource[v]) {
+            origins.push_back(v);
+        }
+    }
+
+    std::vector<FloodResult> results = floodAll(g, origins, numThreads);
+    std::cout << "origin,reach,transmissions,maxLatency,meanLatency\n";
+    for (size_t i = 0; i < origins.size(); ++i) {
+        std::cout << g.names[origins[i]] << "," << results[i].reach << "," << results[i].transmissions << ","
+                  << results[i].maxLatency << "," << results[i].meanLatency << "\n";
+    }
+    return 0;
+}
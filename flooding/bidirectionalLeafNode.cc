@@ -1,19 +1,69 @@
 #include <omnetpp.h>
+#include "aggregation.h"
+#include "memory.h"
+#include "metrics.h"
+#include "pathOracle.h"
 
 using namespace omnetpp;
 
-class BidirectionalLeafNode : public cSimpleModule {
+class BidirectionalLeafNode : public cSimpleModule, public MetricsSource, public MemoryAccountable {
+  private:
+    std::set<int> receivedMessages; // Broadcast IDs seen so far
+    simsignal_t deliveredSignal;    // packetDelivered, counted by the source
+    PathOracle *oracle = nullptr;   // Scores delivery paths, if the network has one
+    cStdDev latencyStats;           // First-arrival delay of each broadcast
+
   protected:
+    virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+  public:
+    virtual void sampleMetrics(std::map<std::string, double> &metrics) const override;
+    virtual void reportMemory(std::map<std::string, size_t> &bytes) const override;
 };
 
 Define_Module(BidirectionalLeafNode);
 
+void BidirectionalLeafNode::initialize() {
+    deliveredSignal = registerSignal("packetDelivered");
+    oracle = PathOracle::find(this);
+}
+
 void BidirectionalLeafNode::handleMessage(cMessage *msg) {
+    if (aggregation::isBundle(msg)) {
+        for (cMessage *payload : aggregation::unbundle(msg)) {
+            handleMessage(payload);
+        }
+        return;
+    }
 
     int messageId = msg->getKind();
     simtime_t delay = simTime() - msg->getTimestamp();
 
+    if (receivedMessages.insert(messageId).second) {
+        emit(deliveredSignal, messageId);
+        if (oracle != nullptr) {
+            oracle->recordBroadcast(messageId, msg->par("origin").stringValue(), getName(), simTime() - msg->getTimestamp());
+        }
+        latencyStats.collect(SIMTIME_DBL(delay));
+    }
+
     EV << "LeafNode : Received message \"" << messageId << "\". Timestamp \"" << delay << "\".\n";
     delete msg;
 }
+
+void BidirectionalLeafNode::reportMemory(std::map<std::string, size_t> &bytes) const {
+    bytes["receivedMessages"] = memory::bytes(receivedMessages);
+}
+
+void BidirectionalLeafNode::sampleMetrics(std::map<std::string, double> &metrics) const {
+    metrics["dedup_entries"] = receivedMessages.size();
+}
+
+void BidirectionalLeafNode::finish() {
+    recordScalar("broadcastsReceived", receivedMessages.size());
+    if (latencyStats.getCount() > 0) {
+        recordScalar("meanLatency", latencyStats.getMean());
+    }
+}
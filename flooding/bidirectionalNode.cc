@@ -1,40 +1,206 @@
 #include <omnetpp.h>
+#include <map>
+#include <vector>
+#include "aggregation.h"
+#include "memory.h"
+#include "metrics.h"
+#include "pathOracle.h"
+#include "scope.h"
 
 using namespace omnetpp;
 
-class BidirectionalNode : public cSimpleModule
+class BidirectionalNode : public cSimpleModule, public MetricsSource, public MemoryAccountable
 {
   private:
     std::set<int> receivedMessages; // Keep track of received message IDs to avoid duplicate flooding
     int routingMsgCount;  // Count of forwarded messages
+    simsignal_t routingSignal;
+    simsignal_t deliveredSignal; // packetDelivered, counted by the source
+    PathOracle *oracle = nullptr; // Scores delivery paths, if the network has one
+    cStdDev latencyStats; // First-arrival delay of each broadcast
+    long duplicateCount = 0; // Copies dropped because the broadcast was already seen
+    long scopeSuppressed = 0; // Copies not sent because they would leave the broadcast's scope
+
+    // Batched delivery: copies from batching neighbors are queued per arrival
+    // time and handled by a single flush event instead of one event per copy
+    struct Arrival {
+        cMessage *msg;
+        cModule *sender;
+    };
+    bool batchArrivals = false;
+    cMessage *flushEvent = nullptr;
+    std::map<simtime_t, std::vector<Arrival>> pendingArrivals;
+
+    // Frame aggregation, see aggregation.h
+    bool aggregate = false;
+    simtime_t aggregationWindow;
+    int maxBundleSize = 8;
+    aggregation::Outbox outbox;
+    cMessage *aggregationEvent = nullptr;
+    long framesSent = 0; // Frames put on the links; a bundle counts once
 
   protected:
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
     virtual void finish() override;
+
+    void handleBroadcast(cMessage *msg, cModule *senderNode);
+    void flushArrivals();
+    void transmit(cMessage *msg, int gateIndex);
+    void flushOutbox();
+
+  public:
+    virtual ~BidirectionalNode();
+
+    // Called by a batching neighbor instead of sending over the link
+    void enqueueArrival(cMessage *msg, cModule *sender, simtime_t arrivalTime);
+
+    virtual void sampleMetrics(std::map<std::string, double> &metrics) const override;
+    virtual void reportMemory(std::map<std::string, size_t> &bytes) const override;
 };
 
 Define_Module(BidirectionalNode);
 
+BidirectionalNode::~BidirectionalNode()
+{
+    cancelAndDelete(flushEvent);
+    cancelAndDelete(aggregationEvent);
+    for (auto &entry : pendingArrivals) {
+        for (Arrival &arrival : entry.second) {
+            delete arrival.msg;
+        }
+    }
+}
+
 void BidirectionalNode::initialize()
 {
     routingMsgCount = 0;
     routingSignal = registerSignal("routingOverhead");
+    deliveredSignal = registerSignal("packetDelivered");
+    oracle = PathOracle::find(this);
+
+    batchArrivals = par("batchArrivals");
+
+    // Batched copies are handed over directly and never cross the channel,
+    // so they would silently escape link losses and crashes
+    for (int i = 0; batchArrivals && i < gateSize("io$o"); ++i) {
+        cChannel *channel = gate("io$o", i)->getChannel();
+        if (channel != nullptr && channel->hasPar("lossModel")
+                && (channel->par("lossModel").stdstringValue() != "none"
+                    || !channel->par("crashSchedule").stdstringValue().empty())) {
+            throw cRuntimeError("batchArrivals cannot be combined with lossy links or crash schedules");
+        }
+    }
+    flushEvent = new cMessage("FlushArrivals");
+
+    aggregate = par("aggregate");
+    aggregationWindow = par("aggregationWindow").doubleValue();
+    maxBundleSize = par("maxBundleSize");
+    aggregationEvent = new cMessage("FlushOutbox");
+    aggregationEvent->setSchedulingPriority(1); // After everything else due at the same time
 }
 
 void BidirectionalNode::handleMessage(cMessage *msg)
+{
+    if (msg == flushEvent) {
+        flushArrivals();
+        return;
+    }
+    if (msg == aggregationEvent) {
+        flushOutbox();
+        return;
+    }
+    if (aggregation::isBundle(msg)) {
+        cModule *senderNode = msg->getSenderModule();
+        for (cMessage *payload : aggregation::unbundle(msg)) {
+            handleBroadcast(payload, senderNode);
+        }
+        return;
+    }
+
+    handleBroadcast(msg, msg->getSenderModule());
+}
+
+// Send a copy now, or queue it for the next aggregated frame on its gate
+void BidirectionalNode::transmit(cMessage *msg, int gateIndex)
+{
+    if (!aggregate) {
+        framesSent++;
+        sendDelayed(msg, 1, "io$o", gateIndex);
+        return;
+    }
+
+    outbox.add(gateIndex, msg);
+    if (!aggregationEvent->isScheduled()) {
+        scheduleAt(simTime() + aggregationWindow, aggregationEvent);
+    }
+}
+
+void BidirectionalNode::flushOutbox()
+{
+    for (const auto &frame : outbox.takeFrames(maxBundleSize)) {
+        framesSent++;
+        sendDelayed(frame.second, 1, "io$o", frame.first);
+    }
+}
+
+void BidirectionalNode::enqueueArrival(cMessage *msg, cModule *sender, simtime_t arrivalTime)
+{
+    Enter_Method_Silent();
+    take(msg);
+
+    pendingArrivals[arrivalTime].push_back({msg, sender});
+
+    if (flushEvent->isScheduled() && flushEvent->getArrivalTime() > arrivalTime) {
+        cancelEvent(flushEvent);
+    }
+    if (!flushEvent->isScheduled()) {
+        scheduleAt(arrivalTime, flushEvent);
+    }
+}
+
+// Handle every copy due now: the first copy of each new broadcast is
+// forwarded, the rest are counted as duplicates and freed together
+void BidirectionalNode::flushArrivals()
+{
+    std::vector<Arrival> batch;
+    batch.swap(pendingArrivals.begin()->second);
+    pendingArrivals.erase(pendingArrivals.begin());
+
+    int duplicates = 0;
+    for (Arrival &arrival : batch) {
+        if (receivedMessages.find(arrival.msg->getKind()) == receivedMessages.end()) {
+            handleBroadcast(arrival.msg, arrival.sender);
+        } else {
+            duplicates++;
+            delete arrival.msg;
+        }
+    }
+    duplicateCount += duplicates;
+
+    if (!pendingArrivals.empty()) {
+        scheduleAt(pendingArrivals.begin()->first, flushEvent);
+    }
+}
+
+void BidirectionalNode::handleBroadcast(cMessage *msg, cModule *senderNode)
 {
     int messageId = msg->getKind();
 
     // If this message ID has already been processed, drop it
     if (receivedMessages.find(messageId) != receivedMessages.end()) {
+        duplicateCount++;
         delete msg;
         return;
     }
 
     receivedMessages.insert(messageId);
-
-    cModule *senderNode = msg->getSenderModule();
+    emit(deliveredSignal, messageId);
+    if (oracle != nullptr) {
+        oracle->recordBroadcast(messageId, msg->par("origin").stringValue(), getName(), simTime() - msg->getTimestamp());
+    }
+    latencyStats.collect(SIMTIME_DBL(simTime() - msg->getTimestamp()));
+    bool hopsLeft = scope::consumeHop(msg);
 
     for (int i = 0; i < gateSize("io$o"); ++i) {
 
@@ -45,11 +211,20 @@ void BidirectionalNode::handleMessage(cMessage *msg)
         if (connectedNode == senderNode) {
            continue; // Skip the node that sent the message
         }
-
+        if (!hopsLeft || !scope::inBox(msg, connectedNode)) {
+            scopeSuppressed++;
+            continue;
+        }
 
         cMessage *copy = msg->dup(); // Duplicate the message for each connection
         routingMsgCount++;
-        sendDelayed(copy, 1, "io$o", i);
+
+        BidirectionalNode *neighbor = dynamic_cast<BidirectionalNode *>(connectedNode);
+        if (batchArrivals && neighbor != nullptr && neighbor->batchArrivals) {
+            neighbor->enqueueArrival(copy, this, simTime() + 1);
+        } else {
+            transmit(copy, i);
+        }
     }
 
     simtime_t delay = simTime() - msg->getTimestamp();
@@ -58,7 +233,33 @@ void BidirectionalNode::handleMessage(cMessage *msg)
     delete msg;
 }
 
+void BidirectionalNode::reportMemory(std::map<std::string, size_t> &bytes) const
+{
+    bytes["receivedMessages"] = memory::bytes(receivedMessages);
+    bytes["pendingArrivals"] = memory::bytes(pendingArrivals);
+}
+
+void BidirectionalNode::sampleMetrics(std::map<std::string, double> &metrics) const
+{
+    metrics["transmissions"] = routingMsgCount;
+    metrics["duplicates_received"] = duplicateCount;
+    metrics["dedup_entries"] = receivedMessages.size();
+    metrics["pending_arrivals"] = pendingArrivals.size();
+    metrics["frames_sent"] = framesSent;
+    metrics["outbox_entries"] = outbox.size();
+}
+
 void BidirectionalNode::finish(){
     EV << "Node : Transmissions \"" << routingMsgCount << "\".\n";
     emit(routingSignal, routingMsgCount);
+
+    // Scalars compared by floodEngine -c
+    recordScalar("transmissions", routingMsgCount);
+    recordScalar("broadcastsReceived", receivedMessages.size());
+    recordScalar("duplicatesReceived", duplicateCount);
+    recordScalar("scopeSuppressed", scopeSuppressed);
+    recordScalar("framesSent", framesSent);
+    if (latencyStats.getCount() > 0) {
+        recordScalar("meanLatency", latencyStats.getMean());
+    }
 }
@@ -1,17 +1,35 @@
 #include <omnetpp.h>
+#include <map>
+#include "scope.h"
 
 using namespace omnetpp;
 
-class BidirectionalSourceNode : public cSimpleModule {
+class BidirectionalSourceNode : public cSimpleModule, public cListener {
+  private:
+    int packetsSent = 0;
+    simsignal_t deliveredSignal;
+    std::map<long, int> deliveries; // Packet ID -> receivers reached
+    int hopLimit = 0;               // Scope of the broadcasts, see scope.h
+    std::string scopeBox;
+
   protected:
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+    // Counts the packetDelivered signals emitted by the receivers
+    virtual void receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) override;
 };
 
 Define_Module(BidirectionalSourceNode);
 
 
 void BidirectionalSourceNode::initialize() {
+   deliveredSignal = registerSignal("packetDelivered");
+   getParentModule()->subscribe(deliveredSignal, this);
+   hopLimit = par("hopLimit");
+   scopeBox = par("scopeBox").stdstringValue();
+
    simtime_t startTime = simTime();
    simtime_t interval = 20;
 
@@ -30,5 +48,33 @@ void BidirectionalSourceNode::handleMessage(cMessage *selfmsg) {
     cMessage *msg = new cMessage("FloodingMessage");
     msg->setKind(id); // Assign a unique ID for tracking
     msg->setTimestamp(simTime());
+    msg->addPar("origin") = getName(); // Kept unchanged along the path
+    scope::stamp(msg, hopLimit, scopeBox);
+    packetsSent++;
+
+    if (!scope::inBox(msg, gate("io$o")->getNextGate()->getOwnerModule())) {
+        delete msg;
+        return;
+    }
     sendDelayed(msg, 1, "io$o"); // Send it to the first output gate with delay 1
 }
+
+void BidirectionalSourceNode::receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) {
+    deliveries[value]++;
+}
+
+void BidirectionalSourceNode::finish() {
+    recordScalar("packetsSent", packetsSent);
+
+    // Every node the scope lets a broadcast reach is a receiver
+    int receivers = scope::receivers(this, hopLimit, scopeBox);
+
+    // Delivery ratio of each packet, and their distribution
+    cStdDev deliveryStats("deliveryRatio");
+    for (int id = 0; id < packetsSent; ++id) {
+        double ratio = receivers > 0 ? (double)deliveries[id] / receivers : 0;
+        deliveryStats.collect(ratio);
+        recordScalar(("deliveryRatio-" + std::to_string(id)).c_str(), ratio);
+    }
+    recordStatistic(&deliveryStats);
+}
@@ -0,0 +1,94 @@
+#include <omnetpp.h>
+#include "aggregation.h"
+#include "memory.h"
+#include "metrics.h"
+#include "pathOracle.h"
+
+using namespace omnetpp;
+
+class BidirectionalLeafNode : public cSimpleModule, public MetricsSource, public MemoryAccountable {
+  private:
+    std::set<int> deliveredMessages; // Broadcast IDs seen so far
+    simsignal_t deliveredSignal;     // packetDelivered, counted by the source
+    PathOracle *oracle = nullptr;    // Scores delivery paths, if the network has one
+    std::string neighbor;            // Learned from its HELLOs
+    cMessage *helloTimer = nullptr;
+    int helloMsgCount = 0;
+
+  protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+  public:
+    virtual ~BidirectionalLeafNode();
+
+    virtual void sampleMetrics(std::map<std::string, double> &metrics) const override;
+    virtual void reportMemory(std::map<std::string, size_t> &bytes) const override;
+};
+
+Define_Module(BidirectionalLeafNode);
+
+BidirectionalLeafNode::~BidirectionalLeafNode() {
+    cancelAndDelete(helloTimer);
+}
+
+void BidirectionalLeafNode::initialize() {
+    deliveredSignal = registerSignal("packetDelivered");
+    oracle = PathOracle::find(this);
+    helloTimer = new cMessage("HelloTimer");
+    scheduleAt(simTime() + uniform(0, par("helloInterval").doubleValue()), helloTimer);
+}
+
+void BidirectionalLeafNode::handleMessage(cMessage *msg) {
+    if (aggregation::isBundle(msg)) {
+        for (cMessage *payload : aggregation::unbundle(msg)) {
+            handleMessage(payload);
+        }
+        return;
+    }
+    if (msg == helloTimer) {
+        // Leaves never relay, but announce themselves so their neighbor's
+        // neighbors see them as two-hop nodes that need covering
+        cMessage *hello = new cMessage("Hello");
+        hello->addPar("source") = getName();
+        hello->addPar("neighbors") = neighbor.c_str();
+        hello->addPar("mprs") = "";
+        helloMsgCount++;
+        sendDelayed(hello, 1, "io$o");
+        scheduleAt(simTime() + par("helloInterval").doubleValue(), helloTimer);
+        return;
+    }
+
+    if (std::string(msg->getName()) == "Hello") {
+        neighbor = msg->par("source").stringValue();
+        delete msg;
+        return;
+    }
+
+    int messageId = msg->getKind();
+    simtime_t delay = simTime() - msg->getTimestamp();
+    if (deliveredMessages.insert(messageId).second) {
+        emit(deliveredSignal, messageId);
+        if (oracle != nullptr) {
+            oracle->recordBroadcast(messageId, msg->par("origin").stringValue(), getName(), simTime() - msg->getTimestamp());
+        }
+    }
+
+    EV << "LeafNode : Received message \"" << messageId << "\". Timestamp \"" << delay << "\".\n";
+    delete msg;
+}
+
+void BidirectionalLeafNode::reportMemory(std::map<std::string, size_t> &bytes) const {
+    bytes["deliveredMessages"] = memory::bytes(deliveredMessages);
+}
+
+void BidirectionalLeafNode::sampleMetrics(std::map<std::string, double> &metrics) const {
+    metrics["hello_messages"] = helloMsgCount;
+    metrics["dedup_entries"] = deliveredMessages.size();
+}
+
+void BidirectionalLeafNode::finish() {
+    recordScalar("helloMessages", helloMsgCount);
+    recordScalar("broadcastsReceived", deliveredMessages.size());
+}
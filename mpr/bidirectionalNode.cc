@@ -0,0 +1,335 @@
+#include <omnetpp.h>
+#include <map>
+#include <set>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include "aggregation.h"
+#include "memory.h"
+#include "metrics.h"
+#include "pathOracle.h"
+
+using namespace omnetpp;
+
+// Multipoint-relay broadcast: nodes learn their two-hop neighborhood from
+// periodic HELLO beacons, select a small set of one-hop neighbors (MPRs) that
+// covers all two-hop neighbors, and only nodes selected as MPR by the sender
+// of a broadcast retransmit it.
+class BidirectionalNode : public cSimpleModule, public MetricsSource, public MemoryAccountable {
+private:
+    std::set<int> receivedMessages;                         // Broadcast IDs seen so far
+    std::set<int> relayedMessages;                          // Broadcast IDs already retransmitted
+    int routingMsgCount = 0;                                // Data copies sent
+    int helloMsgCount = 0;                                  // HELLO copies sent
+    simsignal_t deliveredSignal;                            // packetDelivered, counted by the source
+    PathOracle *oracle = nullptr;                           // Scores delivery paths, if the network has one
+
+    std::map<std::string, simtime_t> lastHeard;             // One-hop neighbors -> time of their last HELLO
+    std::map<std::string, std::set<std::string>> twoHop;    // One-hop neighbor -> its neighbors
+    std::set<std::string> mprSet;                           // Neighbors selected to relay our broadcasts
+    std::set<std::string> mprSelectors;                     // Neighbors that selected this node as MPR
+
+    cMessage *helloTimer = nullptr;
+    simtime_t helloInterval;
+    simtime_t neighborHoldTime;
+
+    // Frame aggregation, see aggregation.h: HELLOs and data copies bound to
+    // the same neighbor share frames
+    bool aggregate = false;
+    simtime_t aggregationWindow;
+    int maxBundleSize = 8;
+    aggregation::Outbox outbox;
+    cMessage *aggregationEvent = nullptr;
+    long framesSent = 0;                                    // Frames put on the links; a bundle counts once
+
+protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+    // HELLO beacons and MPR selection
+    void sendHello();
+    void handleHello(cMessage *hello);
+    void purgeNeighbors();
+    void selectMprs();
+
+    // Broadcast forwarding
+    void handleBroadcast(cMessage *msg, cModule *senderNode);
+    void transmit(cMessage *msg, int gateIndex);
+    void flushOutbox();
+
+    // Helper functions
+    std::string joinNames(const std::set<std::string> &names);
+    std::set<std::string> splitNames(const std::string &names);
+
+public:
+    virtual ~BidirectionalNode();
+
+    virtual void sampleMetrics(std::map<std::string, double> &metrics) const override;
+    virtual void reportMemory(std::map<std::string, size_t> &bytes) const override;
+};
+
+Define_Module(BidirectionalNode);
+
+BidirectionalNode::~BidirectionalNode() {
+    cancelAndDelete(helloTimer);
+    cancelAndDelete(aggregationEvent);
+}
+
+void BidirectionalNode::initialize() {
+    deliveredSignal = registerSignal("packetDelivered");
+    oracle = PathOracle::find(this);
+    helloInterval = par("helloInterval").doubleValue();
+    neighborHoldTime = par("neighborHoldTime").doubleValue();
+
+    aggregate = par("aggregate");
+    aggregationWindow = par("aggregationWindow").doubleValue();
+    maxBundleSize = par("maxBundleSize");
+    aggregationEvent = new cMessage("FlushOutbox");
+    aggregationEvent->setSchedulingPriority(1); // After everything else due at the same time
+
+    // Desynchronize the first beacons
+    helloTimer = new cMessage("HelloTimer");
+    scheduleAt(simTime() + uniform(0, helloInterval), helloTimer);
+}
+
+void BidirectionalNode::handleMessage(cMessage *msg) {
+    if (msg == helloTimer) {
+        purgeNeighbors();
+        selectMprs();
+        sendHello();
+        scheduleAt(simTime() + helloInterval, helloTimer);
+    } else if (msg == aggregationEvent) {
+        flushOutbox();
+    } else if (aggregation::isBundle(msg)) {
+        cModule *senderNode = msg->getSenderModule();
+        for (cMessage *payload : aggregation::unbundle(msg)) {
+            if (std::string(payload->getName()) == "Hello") {
+                handleHello(payload);
+            } else {
+                handleBroadcast(payload, senderNode);
+            }
+        }
+    } else if (std::string(msg->getName()) == "Hello") {
+        handleHello(msg);
+    } else {
+        handleBroadcast(msg, msg->getSenderModule());
+    }
+}
+
+// Send a copy now, or queue it for the next aggregated frame on its gate
+void BidirectionalNode::transmit(cMessage *msg, int gateIndex) {
+    if (!aggregate) {
+        framesSent++;
+        sendDelayed(msg, 1, "io$o", gateIndex);
+        return;
+    }
+
+    outbox.add(gateIndex, msg);
+    if (!aggregationEvent->isScheduled()) {
+        scheduleAt(simTime() + aggregationWindow, aggregationEvent);
+    }
+}
+
+void BidirectionalNode::flushOutbox() {
+    for (const auto &frame : outbox.takeFrames(maxBundleSize)) {
+        framesSent++;
+        sendDelayed(frame.second, 1, "io$o", frame.first);
+    }
+}
+
+void BidirectionalNode::sendHello() {
+    std::set<std::string> neighbors;
+    for (const auto &entry : lastHeard) {
+        neighbors.insert(entry.first);
+    }
+
+    cMessage *hello = new cMessage("Hello");
+    hello->addPar("source") = getName();
+    hello->addPar("neighbors") = joinNames(neighbors).c_str();
+    hello->addPar("mprs") = joinNames(mprSet).c_str();
+
+    for (int i = 0; i < gateSize("io$o"); ++i) {
+        helloMsgCount++;
+        transmit(hello->dup(), i);
+    }
+    delete hello;
+}
+
+void BidirectionalNode::handleHello(cMessage *hello) {
+    std::string sender = hello->par("source").stringValue();
+
+    lastHeard[sender] = simTime();
+    twoHop[sender] = splitNames(hello->par("neighbors").stringValue());
+
+    std::set<std::string> senderMprs = splitNames(hello->par("mprs").stringValue());
+    if (senderMprs.find(getName()) != senderMprs.end()) {
+        mprSelectors.insert(sender);
+    } else {
+        mprSelectors.erase(sender);
+    }
+    delete hello;
+}
+
+// Forget neighbors whose HELLOs stopped arriving
+void BidirectionalNode::purgeNeighbors() {
+    for (auto it = lastHeard.begin(); it != lastHeard.end();) {
+        if (simTime() - it->second > neighborHoldTime) {
+            twoHop.erase(it->first);
+            mprSelectors.erase(it->first);
+            it = lastHeard.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Greedy MPR heuristic: first take neighbors that are the only way to reach
+// some two-hop neighbor, then repeatedly take the neighbor covering the most
+// two-hop neighbors that are still uncovered
+void BidirectionalNode::selectMprs() {
+    std::set<std::string> uncovered;
+    for (const auto &entry : twoHop) {
+        for (const std::string &node : entry.second) {
+            if (node != getName() && lastHeard.find(node) == lastHeard.end()) {
+                uncovered.insert(node);
+            }
+        }
+    }
+
+    mprSet.clear();
+    for (const std::string &node : uncovered) {
+        std::string onlyCover;
+        int covers = 0;
+        for (const auto &entry : twoHop) {
+            if (entry.second.find(node) != entry.second.end()) {
+                onlyCover = entry.first;
+                covers++;
+            }
+        }
+        if (covers == 1) {
+            mprSet.insert(onlyCover);
+        }
+    }
+
+    for (const std::string &mpr : mprSet) {
+        for (const std::string &node : twoHop[mpr]) {
+            uncovered.erase(node);
+        }
+    }
+
+    while (!uncovered.empty()) {
+        std::string best;
+        int bestCount = 0;
+        for (const auto &entry : twoHop) {
+            int count = 0;
+            for (const std::string &node : entry.second) {
+                count += uncovered.count(node);
+            }
+            if (count > bestCount) {
+                best = entry.first;
+                bestCount = count;
+            }
+        }
+        if (bestCount == 0) {
+            break;
+        }
+        mprSet.insert(best);
+        for (const std::string &node : twoHop[best]) {
+            uncovered.erase(node);
+        }
+    }
+}
+
+void BidirectionalNode::handleBroadcast(cMessage *msg, cModule *senderNode) {
+    int messageId = msg->getKind();
+    std::string sender = msg->par("source").stringValue();
+
+    if (receivedMessages.insert(messageId).second) {
+        emit(deliveredSignal, messageId);
+        if (oracle != nullptr) {
+            oracle->recordBroadcast(messageId, msg->par("origin").stringValue(), getName(), simTime() - msg->getTimestamp());
+        }
+        simtime_t delay = simTime() - msg->getTimestamp();
+        EV << "Node : Received message \"" << messageId << "\". Timestamp \"" << delay << "\".\n";
+    }
+
+    // Relay once, on the first copy that comes from a node that selected us as MPR.
+    // The originating source has a single link, so its neighbor always relays.
+    bool fromOriginator = sender == msg->par("origin").stringValue();
+    if (relayedMessages.find(messageId) != relayedMessages.end()
+            || (!fromOriginator && mprSelectors.find(sender) == mprSelectors.end())) {
+        delete msg;
+        return;
+    }
+    relayedMessages.insert(messageId);
+
+    msg->par("source") = getName();
+
+    for (int i = 0; i < gateSize("io$o"); ++i) {
+        cModule *connectedNode = gate("io$o", i)->getNextGate()->getOwnerModule();
+        if (connectedNode == senderNode) {
+            continue; // Skip the node that sent the message
+        }
+        routingMsgCount++;
+        transmit(msg->dup(), i);
+    }
+    delete msg;
+}
+
+std::string BidirectionalNode::joinNames(const std::set<std::string> &names) {
+    std::string joined;
+    for (const std::string &name : names) {
+        joined += (joined.empty() ? "" : " ") + name;
+    }
+    return joined;
+}
+
+std::set<std::string> BidirectionalNode::splitNames(const std::string &names) {
+    std::set<std::string> result;
+    std::stringstream ss(names);
+    std::string name;
+    while (ss >> name) {
+        result.insert(name);
+    }
+    return result;
+}
+
+void BidirectionalNode::reportMemory(std::map<std::string, size_t> &bytes) const {
+    bytes["receivedMessages"] = memory::bytes(receivedMessages);
+    bytes["relayedMessages"] = memory::bytes(relayedMessages);
+    bytes["lastHeard"] = memory::bytes(lastHeard);
+    bytes["twoHop"] = memory::bytes(twoHop);
+    bytes["mprSet"] = memory::bytes(mprSet);
+    bytes["mprSelectors"] = memory::bytes(mprSelectors);
+}
+
+void BidirectionalNode::sampleMetrics(std::map<std::string, double> &metrics) const {
+    metrics["transmissions"] = routingMsgCount;
+    metrics["hello_messages"] = helloMsgCount;
+    metrics["dedup_entries"] = receivedMessages.size() + relayedMessages.size();
+    metrics["neighbors"] = lastHeard.size();
+    metrics["mprs"] = mprSet.size();
+    metrics["frames_sent"] = framesSent;
+    metrics["outbox_entries"] = outbox.size();
+}
+
+void BidirectionalNode::finish() {
+    EV << "Node " << getName() << " finished with " << routingMsgCount << " routing messages and "
+       << helloMsgCount << " HELLO messages.\n";
+    EV << "  - MPRs: ";
+    for (const std::string &mpr : mprSet) {
+        EV << mpr << " ";
+    }
+    EV << "\n  - MPR selectors: ";
+    for (const std::string &selector : mprSelectors) {
+        EV << selector << " ";
+    }
+    EV << "\n";
+
+    recordScalar("transmissions", routingMsgCount);
+    recordScalar("helloMessages", helloMsgCount);
+    recordScalar("broadcastsReceived", receivedMessages.size());
+    recordScalar("mprCount", mprSet.size());
+    recordScalar("framesSent", framesSent);
+}
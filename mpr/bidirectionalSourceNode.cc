@@ -0,0 +1,78 @@
+#include <omnetpp.h>
+#include <map>
+
+using namespace omnetpp;
+
+class BidirectionalSourceNode : public cSimpleModule, public cListener {
+  private:
+    int packetsSent = 0;
+    simsignal_t deliveredSignal;
+    std::map<long, int> deliveries; // Packet ID -> receivers reached
+
+  protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+    // Counts the packetDelivered signals emitted by the receivers
+    virtual void receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) override;
+};
+
+Define_Module(BidirectionalSourceNode);
+
+
+void BidirectionalSourceNode::initialize() {
+   deliveredSignal = registerSignal("packetDelivered");
+   getParentModule()->subscribe(deliveredSignal, this);
+
+   simtime_t startTime = simTime() + par("startTime").doubleValue();
+   simtime_t interval = 20;
+
+   int numExperiments = 10;
+
+   for (int i = 0; i < numExperiments; ++i) {
+     cMessage *selfmsg = new cMessage("ReminderToInit");
+     selfmsg->setKind(i);
+     scheduleAt(startTime + i * interval, selfmsg); // Schedule each message
+   }
+}
+
+void BidirectionalSourceNode::handleMessage(cMessage *msg) {
+    int id = msg->getKind();
+    if (std::string(msg->getName()) == "ReminderToInit") {
+        cMessage *msg = new cMessage("MprMessage");
+        msg->setKind(id); // Assign a unique ID for tracking
+        msg->setTimestamp(simTime());
+        msg->addPar("source") = getName();
+        msg->addPar("origin") = getName();
+        msg->addPar("payload") = "Hello!";
+
+        packetsSent++;
+        sendDelayed(msg, 1, "io$o"); // Send it to the first output gate with delay 1
+    }
+
+    delete msg;
+}
+
+void BidirectionalSourceNode::receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) {
+    deliveries[value]++;
+}
+
+void BidirectionalSourceNode::finish() {
+    recordScalar("packetsSent", packetsSent);
+
+    // Every other node of the network is a receiver
+    int receivers = 0;
+    for (cModule::SubmoduleIterator it(getParentModule()); !it.end(); ++it) {
+        receivers += (*it != this && (*it)->hasGate("io"));
+    }
+
+    // Delivery ratio of each packet, and their distribution
+    cStdDev deliveryStats("deliveryRatio");
+    for (int id = 0; id < packetsSent; ++id) {
+        double ratio = (double)deliveries[id] / receivers;
+        deliveryStats.collect(ratio);
+        recordScalar(("deliveryRatio-" + std::to_string(id)).c_str(), ratio);
+    }
+    recordStatistic(&deliveryStats);
+}
@@ -0,0 +1,189 @@
+"""
+Sequential-stopping replication controller.
+
+Runs the [Replications] config of flooding, DSR, smartGossip and mpr with the same
+run number (and therefore the same seed set) per replication, so the protocols
+are compared with common random numbers. Replications are launched in parallel
+batches until the confidence intervals of delivery ratio and overhead of every
+protocol are narrower than the requested width. A protocol whose replications
+all give the same results is an error: the config lacks a random element.
+
+Example:
+    python replicate.py --jobs 8 --delivery-width 0.02 --overhead-width 0.05
+"""
+
+import argparse
+import math
+import os
+import statistics
+import subprocess
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+PROTOCOLS = {
+    "flooding": "tictoc",
+    "DSR": "DSR",
+    "smartGossip": "smartGossip",
+    "mpr": "mpr",
+}
+
+CONFIG = "Replications"
+
+
+def t_quantile(p, df):
+    """
+    Quantile of Student's t distribution.
+
+    Exact for 1 and 2 degrees of freedom, Cornish-Fisher expansion around the
+    normal quantile otherwise (error well below 1% for df >= 3).
+    """
+    if df == 1:
+        return math.tan(math.pi * (p - 0.5))
+    if df == 2:
+        return (2 * p - 1) * math.sqrt(2 / (4 * p * (1 - p)))
+
+    z = statistics.NormalDist().inv_cdf(p)
+    return (z
+            + (z ** 3 + z) / (4 * df)
+            + (5 * z ** 5 + 16 * z ** 3 + 3 * z) / (96 * df ** 2)
+            + (3 * z ** 7 + 19 * z ** 5 + 17 * z ** 3 - 15 * z) / (384 * df ** 3))
+
+
+def half_width(samples, confidence):
+    """Half-width of the confidence interval of the mean of samples."""
+    if len(samples) < 2:
+        return math.inf
+    return t_quantile(0.5 + confidence / 2, len(samples) - 1) * statistics.stdev(samples) / math.sqrt(len(samples))
+
+
+def read_scalars(filename):
+    """Return {(module, name): value} from an OMNeT++ .sca file."""
+    scalars = {}
+    with open(filename) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) == 4 and fields[0] == "scalar":
+                scalars[(fields[1], fields[2])] = float(fields[3])
+    return scalars
+
+
+# Scalars of control traffic that protocols record apart from their
+# transmissions: mpr's HELLO beacons and smartGossip's repair NACKs
+CONTROL_SCALARS = ("helloMessages", "nacksSent")
+
+# Per-run metrics, in the order metrics() returns them
+METRICS = ("delivery ratio", "overhead", "data overhead", "control overhead")
+
+
+def metrics(scalars):
+    """
+    Delivery ratio and overhead (messages sent per packet sent) of one run.
+    The overhead is also returned split into data transmissions and control
+    traffic (CONTROL_SCALARS), so protocols with beacons are compared on
+    their full cost.
+
+    Broadcast protocols record broadcastsReceived at every receiver; DSR
+    records packetsDelivered at the destination.
+    """
+    def total(name):
+        return sum(v for (module, n), v in scalars.items() if n == name)
+
+    sent = total("packetsSent")
+    if sent == 0:
+        raise ValueError("no packetsSent scalar")
+
+    receivers = sum(1 for (module, n) in scalars if n == "broadcastsReceived")
+    if receivers > 0:
+        delivery = total("broadcastsReceived") / (sent * receivers)
+    else:
+        delivery = total("packetsDelivered") / sent
+
+    data = total("transmissions") / sent
+    control = sum(total(name) for name in CONTROL_SCALARS) / sent
+    return delivery, data + control, data, control
+
+
+def executable(project):
+    for name in (PROTOCOLS[project], PROTOCOLS[project] + ".exe"):
+        if os.path.exists(os.path.join(project, name)):
+            return os.path.join(".", name)
+    raise FileNotFoundError(f"{project}: build the simulation first")
+
+
+def run(project, repetition):
+    """Run one replication of a protocol and return its metrics."""
+    subprocess.run([executable(project), "-u", "Cmdenv", "-c", CONFIG, "-r", str(repetition),
+                    "--cmdenv-express-mode=true", "--cmdenv-status-frequency=1000s"],
+                   cwd=project, check=True, stdout=subprocess.DEVNULL)
+    return metrics(read_scalars(os.path.join(project, "results", f"{CONFIG}-#{repetition}.sca")))
+
+
+def converged(results, args):
+    for samples in results.values():
+        delivery = [s[0] for s in samples]
+        overhead = [s[1] for s in samples]
+        if half_width(delivery, args.confidence) > args.delivery_width / 2:
+            return False
+        if half_width(overhead, args.confidence) > args.overhead_width / 2 * abs(statistics.mean(overhead)):
+            return False
+    return True
+
+
+def report(results, args):
+    n = len(next(iter(results.values())))
+    print(f"\n{n} replications, {args.confidence:.0%} confidence intervals")
+    for project, samples in results.items():
+        for index, label in enumerate(METRICS):
+            values = [s[index] for s in samples]
+            print(f"  {project:12} {label:16} {statistics.mean(values):10.4f} +- {half_width(values, args.confidence):.4f}")
+
+    # Paired differences: common random numbers cancel shared variation
+    projects = list(results)
+    for i in range(len(projects)):
+        for j in range(i + 1, len(projects)):
+            a, b = results[projects[i]], results[projects[j]]
+            for index, label in enumerate(METRICS):
+                diff = [x[index] - y[index] for x, y in zip(a, b)]
+                print(f"  {projects[i]} - {projects[j]} {label}: "
+                      f"{statistics.mean(diff):.4f} +- {half_width(diff, args.confidence):.4f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run replications until the confidence intervals are narrow enough.")
+    parser.add_argument("--protocols", nargs="+", default=list(PROTOCOLS), choices=list(PROTOCOLS))
+    parser.add_argument("--jobs", type=int, default=os.cpu_count(), help="replications run in parallel")
+    parser.add_argument("--confidence", type=float, default=0.95)
+    parser.add_argument("--delivery-width", type=float, default=0.02, help="absolute CI width of the delivery ratio")
+    parser.add_argument("--overhead-width", type=float, default=0.05, help="CI width of the overhead, relative to its mean")
+    parser.add_argument("--min-runs", type=int, default=5)
+    parser.add_argument("--max-runs", type=int, default=1000)
+    args = parser.parse_args()
+
+    os.chdir(os.path.dirname(os.path.abspath(__file__)))
+    results = {project: [] for project in args.protocols}
+    repetition = 0
+
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        while repetition < args.max_runs:
+            batch = range(repetition, min(repetition + args.jobs, args.max_runs))
+            futures = {project: [pool.submit(run, project, r) for r in batch] for project in args.protocols}
+            for project, runs in futures.items():
+                results[project].extend(f.result() for f in runs)
+            repetition = batch.stop
+
+            print(f"{repetition} replications done", file=sys.stderr)
+            if repetition < args.min_runs:
+                continue
+            # Identical replications give zero-width intervals that mean nothing
+            constant = [project for project, samples in results.items() if len(samples) > 1 and len(set(samples)) == 1]
+            if constant:
+                sys.exit(f"{', '.join(constant)}: every replication gave the same results, "
+                         f"the {CONFIG} config has no random element")
+            if converged(results, args):
+                break
+
+    report(results, args)
+
+
+if __name__ == "__main__":
+    main()
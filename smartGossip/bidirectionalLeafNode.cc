@@ -1,19 +1,136 @@
 #include <omnetpp.h>
+#include "aggregation.h"
+#include "checkpoint.h"
+#include "memory.h"
+#include "metrics.h"
+#include "pathOracle.h"
+#include "repair.h"
 
 using namespace omnetpp;
 
-class BidirectionalLeafNode : public cSimpleModule {
+class BidirectionalLeafNode : public cSimpleModule, public Checkpointable, public MetricsSource, public MemoryAccountable {
+  private:
+    std::set<int> deliveredMessages; // Broadcast IDs seen so far
+    simsignal_t deliveredSignal;     // packetDelivered, counted by the source
+    PathOracle *oracle = nullptr;    // Scores delivery paths, if the network has one
+
+    // Broadcast repair, see repair.h. Leaves NACK their single neighbor and
+    // never answer NACKs themselves.
+    bool repairLosses = false;
+    simtime_t nackDelay;
+    int maxNackRetries = 3;
+    repair::GapTracker gaps;
+    cMessage *nackTimer = nullptr;
+    long nacksSent = 0;
+    long repairsReceived = 0;        // Broadcasts first received through a repair
+    long gapsUnrecovered = 0;        // Gaps given up after maxNackRetries NACKs
+
   protected:
+    virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+    void sendNacks();
+
+  public:
+    virtual ~BidirectionalLeafNode();
+
+    // Checkpointable: the sequence numbers seen for gap detection
+    virtual void saveState(std::ostream &out) const override;
+    virtual void loadState(std::istream &in) override;
+    virtual bool canCoordinate() const override { return false; }
+
+    virtual void sampleMetrics(std::map<std::string, double> &metrics) const override;
+    virtual void reportMemory(std::map<std::string, size_t> &bytes) const override;
 };
 
 Define_Module(BidirectionalLeafNode);
 
+BidirectionalLeafNode::~BidirectionalLeafNode() {
+    cancelAndDelete(nackTimer);
+}
+
+void BidirectionalLeafNode::initialize() {
+    deliveredSignal = registerSignal("packetDelivered");
+    oracle = PathOracle::find(this);
+
+    repairLosses = par("repair");
+    nackDelay = par("nackDelay").doubleValue();
+    maxNackRetries = par("maxNackRetries");
+    nackTimer = new cMessage("NackTimer");
+}
+
 void BidirectionalLeafNode::handleMessage(cMessage *msg) {
+    if (aggregation::isBundle(msg)) {
+        for (cMessage *payload : aggregation::unbundle(msg)) {
+            handleMessage(payload);
+        }
+        return;
+    }
+    if (msg == nackTimer) {
+        sendNacks();
+        return;
+    }
+    if (repair::isNack(msg)) {
+        delete msg; // Nothing to repair from
+        return;
+    }
 
     int messageId = msg->getKind();
     simtime_t delay = simTime() - msg->getTimestamp();
+    if (deliveredMessages.insert(messageId).second) {
+        emit(deliveredSignal, messageId);
+        if (oracle != nullptr) {
+            oracle->recordBroadcast(messageId, msg->par("origin").stringValue(), getName(), simTime() - msg->getTimestamp());
+        }
+        repairsReceived += repair::isRepair(msg);
+    }
+    if (repairLosses) {
+        gaps.received(msg->par("origin").stringValue(), messageId);
+        if (!gaps.empty() && !nackTimer->isScheduled()) {
+            scheduleAt(simTime() + nackDelay, nackTimer);
+        }
+    }
 
     EV << "LeafNode : Received message \"" << messageId << "\". Timestamp \"" << delay << "\".\n";
     delete msg;
 }
+
+void BidirectionalLeafNode::sendNacks() {
+    for (const auto& [origin, seqs] : gaps.due(maxNackRetries, gapsUnrecovered)) {
+        nacksSent++;
+        sendDelayed(repair::makeNack(getName(), origin, seqs), 1, "io$o");
+    }
+    if (!gaps.empty()) {
+        scheduleAt(simTime() + nackDelay, nackTimer);
+    }
+}
+
+void BidirectionalLeafNode::saveState(std::ostream &out) const {
+    gaps.save(out);
+}
+
+void BidirectionalLeafNode::loadState(std::istream &in) {
+    gaps.load(in);
+}
+
+void BidirectionalLeafNode::reportMemory(std::map<std::string, size_t> &bytes) const {
+    bytes["deliveredMessages"] = memory::bytes(deliveredMessages);
+    bytes["gaps"] = gaps.bytes();
+}
+
+void BidirectionalLeafNode::sampleMetrics(std::map<std::string, double> &metrics) const {
+    metrics["dedup_entries"] = deliveredMessages.size();
+    metrics["nacks_sent"] = nacksSent;
+    metrics["repairs_received"] = repairsReceived;
+    metrics["open_gaps"] = gaps.size();
+}
+
+void BidirectionalLeafNode::finish() {
+    recordScalar("broadcastsReceived", deliveredMessages.size());
+    if (repairLosses) {
+        recordScalar("nacksSent", nacksSent);
+        recordScalar("repairsReceived", repairsReceived);
+        recordScalar("gapsUnrecovered", gapsUnrecovered + gaps.size());
+    }
+}
@@ -2,15 +2,48 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <deque>
 #include <cmath>  // For random probability
 #include <omnetpp.h>
+#include "aggregation.h"
+#include "checkpoint.h"
+#include "memory.h"
+#include "metrics.h"
+#include "pathOracle.h"
+#include "repair.h"
+#include "scope.h"
 
 using namespace omnetpp;
 
-class BidirectionalNode : public cSimpleModule {
+class BidirectionalNode : public cSimpleModule, public Checkpointable, public MetricsSource, public MemoryAccountable {
 private:
-    std::set<int> receivedMessages;
+    std::set<int> receivedMessages;   // Broadcasts this node forwarded
+    std::set<int> deliveredMessages;  // Broadcasts this node received
+    simsignal_t deliveredSignal;      // packetDelivered, counted by the source
+    PathOracle *oracle = nullptr;     // Scores delivery paths, if the network has one
     int routingMsgCount = 0;
+    long scopeSuppressed = 0;  // Copies not sent because they would leave the broadcast's scope
+    cMessage *checkpointEvent = nullptr;  // Coordinator only: time to write the checkpoint
+
+    // Frame aggregation, see aggregation.h
+    bool aggregate = false;
+    simtime_t aggregationWindow;
+    int maxBundleSize = 8;
+    aggregation::Outbox outbox;
+    cMessage *aggregationEvent = nullptr;
+    long framesSent = 0;  // Frames put on the links; a bundle counts once
+
+    // Broadcast repair, see repair.h
+    bool repairLosses = false;
+    simtime_t nackDelay;
+    int maxNackRetries = 3;
+    repair::RetransmitBuffer repairBuffer;
+    repair::GapTracker gaps;
+    cMessage *nackTimer = nullptr;
+    long nacksSent = 0;
+    long repairsSent = 0;       // Repair copies sent, also counted in routingMsgCount
+    long repairsReceived = 0;   // Broadcasts first received through a repair
+    long gapsUnrecovered = 0;   // Gaps given up after maxNackRetries NACKs
 
     // Sets for managing neighbors, parents, siblings, and children
     std::unordered_set<std::string> NeighborSet;
@@ -25,8 +58,28 @@ private:
     double tauRel = 0.8;
     double delta = 6;
 
+    // Adaptive threshold: per-origin sliding window over the latest sequence
+    // numbers (message IDs), each slot holding the number of copies received
+    // (0 = missed). The newest slot is open: copies of it may still arrive.
+    struct OriginWindow {
+        int highestSeq = -1;
+        std::deque<std::pair<int, int>> slots;
+    };
+    bool adaptiveThreshold = false;
+    double minThreshold = 0.5;
+    double maxThreshold = 1.0;
+    double targetReliability = 0.95;
+    double targetRedundancy = 1.0;   // Extra copies per message considered enough
+    double adaptStep = 0.02;
+    int windowSize = 5;
+    std::map<std::string, OriginWindow> originWindows;
+    cOutVector thresholdVector;
+    cOutVector reliabilityVector;
+    cOutVector redundancyVector;
+
 protected:
-    virtual void initialize() override;
+    virtual int numInitStages() const override { return 2; }
+    virtual void initialize(int stage) override;
     virtual void handleMessage(cMessage *msg) override;
 
     // Process incoming messages
@@ -39,23 +92,122 @@ protected:
     double calculateGossipProbability();
     double calculatePrequired(double tauRel, double delta);
     double calculatePgossip();
+    bool recordReception(const std::string& origin, int seq);
+    void adaptThreshold(const std::string& origin);
 
     // Broadcast a message to neighbors based on gossip probability
     void broadcastMessage(cMessage *msg);
+    void transmit(cMessage *msg, int gateIndex);
+    void flushOutbox();
+
+    // Broadcast repair
+    void noteReception(cMessage *msg, bool firstCopy, bool hopsLeft);
+    void sendNacks();
+    void handleNack(cMessage *nack);
+    void handleRepair(cMessage *msg);
+    int gateTo(const std::string &nodeName);
     virtual void finish() override;
+
+public:
+    virtual ~BidirectionalNode();
+
+    // Checkpointable: dedup set, neighbor classification, children's prequired,
+    // adaptive threshold state and the sequence numbers seen for gap detection
+    virtual void saveState(std::ostream &out) const override;
+    virtual void loadState(std::istream &in) override;
+
+    virtual void sampleMetrics(std::map<std::string, double> &metrics) const override;
+    virtual void reportMemory(std::map<std::string, size_t> &bytes) const override;
 };
 
 Define_Module(BidirectionalNode);
 
-void BidirectionalNode::initialize() {
+BidirectionalNode::~BidirectionalNode() {
+    cancelAndDelete(checkpointEvent);
+    cancelAndDelete(aggregationEvent);
+    cancelAndDelete(nackTimer);
+}
+
+void BidirectionalNode::initialize(int stage) {
+    if (stage == 1) {
+        // Restore warm state and schedule the checkpoint on behalf of the network
+        cModule *network = getParentModule();
+        if (checkpoint::isCoordinator(this)) {
+            std::string restoreFile = network->par("restoreFile").stdstringValue();
+            if (!restoreFile.empty()) {
+                checkpoint::restore(network, restoreFile);
+            }
+            simtime_t checkpointTime = network->par("checkpointTime").doubleValue();
+            if (!network->par("checkpointFile").stdstringValue().empty() && checkpointTime >= 0) {
+                checkpointEvent = new cMessage("Checkpoint");
+                scheduleAt(checkpointTime, checkpointEvent);
+            }
+        }
+        return;
+    }
+
+    deliveredSignal = registerSignal("packetDelivered");
+    oracle = PathOracle::find(this);
+
     std::string myName = getName();
     NeighborSet.insert(myName);  // Insert the node into its own NeighborSet
     SiblingSet.insert(myName);   // Insert the node into its own SiblingSet
 
-    gossipThreshold = 0.8;
+    gossipThreshold = par("gossipThreshold");
+
+    adaptiveThreshold = par("adaptiveThreshold");
+    minThreshold = par("minThreshold");
+    maxThreshold = par("maxThreshold");
+    targetReliability = par("targetReliability");
+    targetRedundancy = par("targetRedundancy");
+    adaptStep = par("adaptStep");
+    windowSize = par("windowSize");
+
+    aggregate = par("aggregate");
+    aggregationWindow = par("aggregationWindow").doubleValue();
+    maxBundleSize = par("maxBundleSize");
+    aggregationEvent = new cMessage("FlushOutbox");
+    aggregationEvent->setSchedulingPriority(1);  // After everything else due at the same time
+
+    repairLosses = par("repair");
+    nackDelay = par("nackDelay").doubleValue();
+    maxNackRetries = par("maxNackRetries");
+    repairBuffer.setCapacity(repairLosses ? (int)par("repairBufferSize") : 0);
+    nackTimer = new cMessage("NackTimer");
+
+    thresholdVector.setName("gossipThreshold");
+    reliabilityVector.setName("observedReliability");
+    redundancyVector.setName("observedRedundancy");
 }
 
 void BidirectionalNode::handleMessage(cMessage *msg) {
+    if (msg == checkpointEvent) {
+        checkpoint::save(getParentModule(), getParentModule()->par("checkpointFile").stdstringValue());
+        return;
+    }
+    if (msg == aggregationEvent) {
+        flushOutbox();
+        return;
+    }
+    if (aggregation::isBundle(msg)) {
+        for (cMessage *payload : aggregation::unbundle(msg)) {
+            handleMessage(payload);
+        }
+        return;
+    }
+    if (msg == nackTimer) {
+        sendNacks();
+        return;
+    }
+    if (repair::isNack(msg)) {
+        handleNack(msg);
+        return;
+    }
+    if (repair::isRepair(msg)) {
+        handleRepair(msg);
+        return;
+    }
+
     int messageId = msg->getKind();
 
     simtime_t delay = simTime() - msg->getTimestamp();
@@ -68,9 +220,20 @@ void BidirectionalNode::handleMessage(cMessage *msg) {
 void BidirectionalNode::handleMessageFromNode(cMessage *msg) {
 
     int messageId = msg->getKind();
+    bool firstCopy = deliveredMessages.insert(messageId).second;
+    if (firstCopy) {
+        emit(deliveredSignal, messageId);
+        if (oracle != nullptr) {
+            oracle->recordBroadcast(messageId, msg->par("origin").stringValue(), getName(), simTime() - msg->getTimestamp());
+        }
+    }
     std::string sender = msg->par("source").stringValue();  // Node sending the message
     std::string parentId = msg->par("pid").stringValue();   // Parent ID from the message
     double prequired = calculatePrequired(tauRel, delta);
+    bool hopsLeft = scope::consumeHop(msg);
+    if (repairLosses) {
+        noteReception(msg, firstCopy, hopsLeft);
+    }
 
     // Update sets based on sender and parent ID
     updateSets(sender, parentId);
@@ -80,13 +243,26 @@ void BidirectionalNode::handleMessageFromNode(cMessage *msg) {
         latestPrequired[sender] = prequired;  // Update the latest prequired for this child
     }
 
+    if (adaptiveThreshold) {
+        std::string origin = msg->par("origin").stringValue();
+        if (recordReception(origin, messageId)) {
+            adaptThreshold(origin);
+        }
+    }
+
     // Calculate gossip probability as the maximum prequired from children
     double pgossip = calculatePgossip();
     EV << "Calculated gossip probability: " << pgossip << "\n";
 
 
-    // Decide whether to forward the message
-    if (pgossip > uniform(0, 1) && receivedMessages.find(messageId) == receivedMessages.end()) {
+    // Decide whether to forward the message. A copy whose hop budget ran out
+    // does not mark the broadcast as forwarded: a later copy with hops left may
+    bool forward = pgossip > uniform(0, 1) && receivedMessages.find(messageId) == receivedMessages.end();
+    if (forward && !hopsLeft) {
+        scopeSuppressed += gateSize("io$o");
+        forward = false;
+    }
+    if (forward) {
 
         msg->par("pid").setStringValue(msg->par("source"));
         msg->par("source").setStringValue(getName());
@@ -115,6 +291,66 @@ double BidirectionalNode::calculatePgossip() {
     return std::max(maxPrequired, gossipThreshold);
 }
 
+// Count a received copy in the origin's window; sequence numbers skipped
+// over are recorded as missed until (if ever) they arrive. True if the copy
+// opened a new slot, which closes the slots before it.
+bool BidirectionalNode::recordReception(const std::string& origin, int seq) {
+    OriginWindow &window = originWindows[origin];
+
+    if (seq > window.highestSeq) {
+        bool closed = !window.slots.empty();
+        for (int missed = window.highestSeq + 1; missed < seq; ++missed) {
+            window.slots.push_back(std::make_pair(missed, 0));
+        }
+        window.slots.push_back(std::make_pair(seq, 1));
+        window.highestSeq = seq;
+        while ((int)window.slots.size() > windowSize) {
+            window.slots.pop_front();
+        }
+        return closed;
+    }
+
+    for (auto& slot : window.slots) {
+        if (slot.first == seq) {
+            slot.second++;
+            break;
+        }
+    }
+    return false;
+}
+
+// Adapt over the closed slots of the window, once a new slot opens and their
+// copies are all counted. The threshold moves one step up while the missed
+// slots put the observed reliability below the target, one step down while
+// the messages received show more duplicates than needed.
+void BidirectionalNode::adaptThreshold(const std::string& origin) {
+    const OriginWindow &window = originWindows[origin];
+
+    int closed = window.slots.size() - 1;
+    if (closed <= 0) {
+        return;
+    }
+
+    int missed = 0, duplicates = 0;
+    for (int i = 0; i < closed; ++i) {
+        int copies = window.slots[i].second;
+        missed += copies == 0;
+        duplicates += std::max(copies - 1, 0);
+    }
+    int received = closed - missed;
+    double reliability = (double)received / closed;
+    double redundancy = received > 0 ? (double)duplicates / received : 0;
+
+    if (reliability < targetReliability) {
+        gossipThreshold = std::min(maxThreshold, gossipThreshold + adaptStep);
+    } else if (redundancy > targetRedundancy) {
+        gossipThreshold = std::max(minThreshold, gossipThreshold - adaptStep);
+    }
+
+    thresholdVector.record(gossipThreshold);
+    reliabilityVector.record(reliability);
+    redundancyVector.record(redundancy);
+}
 
 // Update the sets based on the parent ID
 void BidirectionalNode::updateSets(const std::string& sender, const std::string& parentId) {
@@ -143,16 +379,234 @@ void BidirectionalNode::broadcastMessage(cMessage *msg) {
     cModule *senderNode = msg->getSenderModule();
 
     for (int i = 0; i < gateSize("io$o"); ++i) {
+       if (!scope::inBox(msg, gate("io$o", i)->getNextGate()->getOwnerModule())) {
+           scopeSuppressed++;
+           continue;
+       }
        cMessage *copy = msg->dup(); // Duplicate the message for each connection
        routingMsgCount++;
-       sendDelayed(copy, 1, "io$o", i);
+       transmit(copy, i);
     }
     delete msg;
 }
 
+// Send a copy now, or queue it for the next aggregated frame on its gate
+void BidirectionalNode::transmit(cMessage *msg, int gateIndex) {
+    if (!aggregate) {
+        framesSent++;
+        sendDelayed(msg, 1, "io$o", gateIndex);
+        return;
+    }
+
+    outbox.add(gateIndex, msg);
+    if (!aggregationEvent->isScheduled()) {
+        scheduleAt(simTime() + aggregationWindow, aggregationEvent);
+    }
+}
+
+void BidirectionalNode::flushOutbox() {
+    for (const auto& frame : outbox.takeFrames(maxBundleSize)) {
+        framesSent++;
+        sendDelayed(frame.second, 1, "io$o", frame.first);
+    }
+}
+
+// Track gaps in the origin's sequence numbers and keep the first copy of a
+// broadcast for repairs. Copies out of hops are not kept: the broadcast may
+// not travel further than this node.
+void BidirectionalNode::noteReception(cMessage *msg, bool firstCopy, bool hopsLeft) {
+    std::string origin = msg->par("origin").stringValue();
+    if (gaps.received(origin, msg->getKind())) {
+        EV << "Node " << getName() << " closed gap " << origin << "#" << msg->getKind() << " by gossip.\n";
+    }
+    if (firstCopy && hopsLeft) {
+        repairBuffer.store(msg->dup());
+    }
+    if (!gaps.empty() && !nackTimer->isScheduled()) {
+        scheduleAt(simTime() + nackDelay, nackTimer);
+    }
+}
+
+// NACK the open gaps to the parents, or to every neighbor while there are none
+void BidirectionalNode::sendNacks() {
+    std::vector<int> targets;
+    for (int i = 0; i < gateSize("io$o"); ++i) {
+        if (ParentSet.count(gate("io$o", i)->getNextGate()->getOwnerModule()->getName()) > 0) {
+            targets.push_back(i);
+        }
+    }
+    for (int i = 0; targets.empty() && i < gateSize("io$o"); ++i) {
+        targets.push_back(i);
+    }
+
+    for (const auto& [origin, seqs] : gaps.due(maxNackRetries, gapsUnrecovered)) {
+        for (int i : targets) {
+            nacksSent++;
+            transmit(repair::makeNack(getName(), origin, seqs), i);
+        }
+    }
+
+    if (!gaps.empty()) {
+        scheduleAt(simTime() + nackDelay, nackTimer);
+    }
+}
+
+// Answer a NACK with the requested broadcasts still held, within their scope
+void BidirectionalNode::handleNack(cMessage *nack) {
+    std::string origin = nack->par("origin").stringValue();
+    int gateIndex = gateTo(nack->par("source").stringValue());
+
+    for (int seq : repair::nackedSeqs(nack)) {
+        cMessage *held = repairBuffer.find(origin, seq);
+        if (held == nullptr || gateIndex < 0
+                || !scope::inBox(held, gate("io$o", gateIndex)->getNextGate()->getOwnerModule())) {
+            continue;
+        }
+        cMessage *copy = held->dup();
+        copy->setName("Repair");
+        copy->par("source").setStringValue(getName());
+        repairsSent++;
+        routingMsgCount++;
+        transmit(copy, gateIndex);
+    }
+    delete nack;
+}
+
+// Repaired broadcasts are delivered and kept for repairs, never gossiped.
+// Like gossiped copies, they are only served further while hops are left.
+void BidirectionalNode::handleRepair(cMessage *msg) {
+    int messageId = msg->getKind();
+    std::string origin = msg->par("origin").stringValue();
+    bool hopsLeft = scope::consumeHop(msg);
+
+    if (deliveredMessages.insert(messageId).second) {
+        emit(deliveredSignal, messageId);
+        if (oracle != nullptr) {
+            oracle->recordBroadcast(messageId, origin, getName(), simTime() - msg->getTimestamp());
+        }
+        repairsReceived++;
+        if (repairLosses && hopsLeft) {
+            repairBuffer.store(msg->dup());
+        }
+    }
+    if (repairLosses) {
+        gaps.received(origin, messageId);
+    }
+    delete msg;
+}
+
+int BidirectionalNode::gateTo(const std::string &nodeName) {
+    for (int i = 0; i < gateSize("io$o"); ++i) {
+        if (nodeName == gate("io$o", i)->getNextGate()->getOwnerModule()->getName()) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void BidirectionalNode::saveState(std::ostream &out) const {
+    using namespace checkpoint;
+
+    writeU32(out, receivedMessages.size());
+    for (int messageId : receivedMessages) {
+        writeU32(out, messageId);
+    }
+    writeStringSet(out, NeighborSet);
+    writeStringSet(out, ParentSet);
+    writeStringSet(out, SiblingSet);
+    writeStringSet(out, ChildSet);
+    writeU32(out, latestPrequired.size());
+    for (const auto& [child, prequired] : latestPrequired) {
+        writeString(out, child);
+        writeDouble(out, prequired);
+    }
+    writeDouble(out, gossipThreshold);
+    writeU32(out, originWindows.size());
+    for (const auto& [origin, window] : originWindows) {
+        writeString(out, origin);
+        writeU32(out, window.highestSeq + 1);
+        writeU32(out, window.slots.size());
+        for (const auto& slot : window.slots) {
+            writeU32(out, slot.first);
+            writeU32(out, slot.second);
+        }
+    }
+    gaps.save(out);
+}
+
+void BidirectionalNode::loadState(std::istream &in) {
+    using namespace checkpoint;
+
+    for (uint32_t n = readU32(in); n > 0; --n) {
+        receivedMessages.insert(readU32(in));
+    }
+    readStringSet(in, NeighborSet);
+    readStringSet(in, ParentSet);
+    readStringSet(in, SiblingSet);
+    readStringSet(in, ChildSet);
+    for (uint32_t n = readU32(in); n > 0; --n) {
+        std::string child = readString(in);
+        latestPrequired[child] = readDouble(in);
+    }
+    gossipThreshold = readDouble(in);
+    for (uint32_t n = readU32(in); n > 0; --n) {
+        OriginWindow &window = originWindows[readString(in)];
+        window.highestSeq = (int)readU32(in) - 1;
+        for (uint32_t s = readU32(in); s > 0; --s) {
+            int seq = readU32(in);
+            window.slots.push_back(std::make_pair(seq, (int)readU32(in)));
+        }
+    }
+    gaps.load(in);
+}
+
+void BidirectionalNode::reportMemory(std::map<std::string, size_t> &bytes) const {
+    bytes["receivedMessages"] = memory::bytes(receivedMessages);
+    bytes["deliveredMessages"] = memory::bytes(deliveredMessages);
+    bytes["NeighborSet"] = memory::bytes(NeighborSet);
+    bytes["ParentSet"] = memory::bytes(ParentSet);
+    bytes["SiblingSet"] = memory::bytes(SiblingSet);
+    bytes["ChildSet"] = memory::bytes(ChildSet);
+    bytes["latestPrequired"] = memory::bytes(latestPrequired);
+    bytes["originWindows"] = memory::bytes(originWindows);
+    for (const auto& [origin, window] : originWindows) {
+        bytes["originWindows"] += memory::heapBytes(window.slots);
+    }
+    bytes["repairBuffer"] = repairBuffer.bytes();
+    bytes["gaps"] = gaps.bytes();
+}
+
+void BidirectionalNode::sampleMetrics(std::map<std::string, double> &metrics) const {
+    metrics["transmissions"] = routingMsgCount;
+    metrics["dedup_entries"] = receivedMessages.size() + deliveredMessages.size();
+    metrics["neighbors"] = NeighborSet.size();
+    metrics["parents"] = ParentSet.size();
+    metrics["siblings"] = SiblingSet.size();
+    metrics["children"] = ChildSet.size();
+    metrics["gossip_threshold"] = gossipThreshold;
+    metrics["frames_sent"] = framesSent;
+    metrics["outbox_entries"] = outbox.size();
+    metrics["nacks_sent"] = nacksSent;
+    metrics["repairs_sent"] = repairsSent;
+    metrics["repairs_received"] = repairsReceived;
+    metrics["repair_buffer_entries"] = repairBuffer.size();
+    metrics["open_gaps"] = gaps.size();
+}
+
 void BidirectionalNode::finish() {
     // Output the total number of routing messages sent by the node
     EV << "Node " << getName() << " finished with " << routingMsgCount << " routing messages.\n";
+    recordScalar("transmissions", routingMsgCount);
+    recordScalar("broadcastsReceived", deliveredMessages.size());
+    recordScalar("finalGossipThreshold", gossipThreshold);
+    recordScalar("scopeSuppressed", scopeSuppressed);
+    recordScalar("framesSent", framesSent);
+    if (repairLosses) {
+        recordScalar("nacksSent", nacksSent);
+        recordScalar("repairsSent", repairsSent);
+        recordScalar("repairsReceived", repairsReceived);
+        recordScalar("gapsUnrecovered", gapsUnrecovered + gaps.size());
+    }
 
     // Output the sizes of each set
     EV << "Node " << getName() << " statistics:\n";
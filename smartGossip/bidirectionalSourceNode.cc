@@ -1,17 +1,49 @@
 #include <omnetpp.h>
+#include <map>
+#include "aggregation.h"
+#include "checkpoint.h"
+#include "repair.h"
+#include "scope.h"
 
 using namespace omnetpp;
 
-class BidirectionalSourceNode : public cSimpleModule {
+class BidirectionalSourceNode : public cSimpleModule, public cListener, public Checkpointable {
+  private:
+    int packetsSent = 0;
+    int firstId = 0;                // ID of the first broadcast; a warm start resumes after the checkpointed run
+    simsignal_t deliveredSignal;
+    std::map<long, int> deliveries; // Packet ID -> receivers reached
+    int hopLimit = 0;               // Scope of the broadcasts, see scope.h
+    std::string scopeBox;
+    repair::RetransmitBuffer repairBuffer; // Broadcasts sent, to answer NACKs of the first hop
+    long repairsSent = 0;
+
   protected:
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+    // Counts the packetDelivered signals emitted by the receivers
+    virtual void receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) override;
+
+  public:
+    // Checkpointable: the next broadcast ID, so the IDs in the nodes' restored
+    // dedup sets and sequence windows are not reused
+    virtual void saveState(std::ostream &out) const override;
+    virtual void loadState(std::istream &in) override;
+    virtual bool canCoordinate() const override { return false; }
 };
 
 Define_Module(BidirectionalSourceNode);
 
 
 void BidirectionalSourceNode::initialize() {
+   deliveredSignal = registerSignal("packetDelivered");
+   getParentModule()->subscribe(deliveredSignal, this);
+   hopLimit = par("hopLimit");
+   scopeBox = par("scopeBox").stdstringValue();
+   repairBuffer.setCapacity(par("repair").boolValue() ? (int)par("repairBufferSize") : 0);
+
    simtime_t startTime = simTime();
    simtime_t interval = 20;
 
@@ -25,17 +57,73 @@ void BidirectionalSourceNode::initialize() {
 }
 
 void BidirectionalSourceNode::handleMessage(cMessage *msg) {
-    int id = msg->getKind();
+    if (aggregation::isBundle(msg)) {
+        for (cMessage *payload : aggregation::unbundle(msg)) {
+            handleMessage(payload);
+        }
+        return;
+    }
+
+    int id = firstId + msg->getKind();
     if (std::string(msg->getName()) == "ReminderToInit") {
         cMessage *msg = new cMessage("SmartGossipMessage");
         msg->setKind(id); // Assign a unique ID for tracking
         msg->setTimestamp(simTime());
         msg->addPar("source") = getName();
         msg->addPar("pid") = getName();
+        msg->addPar("origin") = getName(); // Kept unchanged along the path
         msg->addPar("payload") = "Hello!";
+        scope::stamp(msg, hopLimit, scopeBox);
 
-        sendDelayed(msg, 1, "io$o"); // Send it to the first output gate with delay 1
+        packetsSent++;
+        if (scope::inBox(msg, gate("io$o")->getNextGate()->getOwnerModule())) {
+            repairBuffer.store(msg->dup());
+            sendDelayed(msg, 1, "io$o"); // Send it to the first output gate with delay 1
+        } else {
+            delete msg;
+        }
+    } else if (repair::isNack(msg)) {
+        for (int seq : repair::nackedSeqs(msg)) {
+            cMessage *held = repairBuffer.find(msg->par("origin").stringValue(), seq);
+            if (held != nullptr) {
+                cMessage *copy = held->dup();
+                copy->setName("Repair");
+                repairsSent++;
+                sendDelayed(copy, 1, "io$o");
+            }
+        }
     }
 
     delete msg;
 }
+
+void BidirectionalSourceNode::saveState(std::ostream &out) const {
+    checkpoint::writeU32(out, firstId + packetsSent);
+}
+
+void BidirectionalSourceNode::loadState(std::istream &in) {
+    firstId = checkpoint::readU32(in);
+}
+
+void BidirectionalSourceNode::receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) {
+    deliveries[value]++;
+}
+
+void BidirectionalSourceNode::finish() {
+    recordScalar("packetsSent", packetsSent);
+    if (par("repair").boolValue()) {
+        recordScalar("repairsSent", repairsSent);
+    }
+
+    // Every node the scope lets a broadcast reach is a receiver
+    int receivers = scope::receivers(this, hopLimit, scopeBox);
+
+    // Delivery ratio of each packet, and their distribution
+    cStdDev deliveryStats("deliveryRatio");
+    for (int id = firstId; id < firstId + packetsSent; ++id) {
+        double ratio = receivers > 0 ? (double)deliveries[id] / receivers : 0;
+        deliveryStats.collect(ratio);
+        recordScalar(("deliveryRatio-" + std::to_string(id)).c_str(), ratio);
+    }
+    recordStatistic(&deliveryStats);
+}
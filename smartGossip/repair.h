@@ -0,0 +1,184 @@
+#ifndef REPAIR_H
+#define REPAIR_H
+
+#include <omnetpp.h>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "checkpoint.h"
+#include "memory.h"
+
+using namespace omnetpp;
+
+// Reliable broadcast repair.
+//
+// The message ID of a broadcast doubles as its sequence number within the
+// broadcasts of its origin. A node with repair = true tracks the highest
+// sequence number received per origin; receiving a higher one than the next
+// expected opens a gap for every number skipped. Gaps are NACKed to the
+// neighbors in ParentSet (all neighbors while it is empty) nackDelay after
+// they open, and again every nackDelay until repaired or maxNackRetries NACKs
+// went unanswered. Nodes and the source hold the last repairBufferSize
+// broadcasts they received or sent and answer NACKs with "Repair" copies,
+// which are delivered but not gossiped further: downstream nodes that missed
+// the broadcast too repair it from their own parents. Repairs respect the
+// broadcast's scope: they carry its remaining hop budget, are only served to
+// neighbors inside its box, and a node keeps a broadcast for repairs only
+// while hops are left.
+//
+// Losing the last broadcasts of an origin goes unnoticed until it sends again.
+
+namespace repair {
+
+inline bool isNack(cMessage *msg) {
+    return strcmp(msg->getName(), "Nack") == 0;
+}
+
+inline bool isRepair(cMessage *msg) {
+    return strcmp(msg->getName(), "Repair") == 0;
+}
+
+// "Nack" from requester for the listed sequence numbers of origin
+inline cMessage *makeNack(const std::string &requester, const std::string &origin, const std::vector<int> &seqs) {
+    std::string list;
+    for (int seq : seqs) {
+        list += (list.empty() ? "" : " ") + std::to_string(seq);
+    }
+
+    cMessage *nack = new cMessage("Nack");
+    nack->addPar("source") = requester.c_str();
+    nack->addPar("origin") = origin.c_str();
+    nack->addPar("seqs") = list.c_str();
+    return nack;
+}
+
+inline std::vector<int> nackedSeqs(cMessage *nack) {
+    std::vector<int> seqs;
+    std::stringstream ss(nack->par("seqs").stringValue());
+    int seq;
+    while (ss >> seq) {
+        seqs.push_back(seq);
+    }
+    return seqs;
+}
+
+// Bounded FIFO of broadcasts kept to answer NACKs, oldest evicted first
+class RetransmitBuffer {
+  private:
+    size_t capacity = 0;
+    std::deque<cMessage *> held;
+
+  public:
+    ~RetransmitBuffer() {
+        for (cMessage *msg : held) {
+            delete msg;
+        }
+    }
+
+    void setCapacity(size_t n) {
+        capacity = n;
+    }
+
+    // Takes ownership of msg
+    void store(cMessage *msg) {
+        held.push_back(msg);
+        while (held.size() > capacity) {
+            delete held.front();
+            held.pop_front();
+        }
+    }
+
+    cMessage *find(const std::string &origin, int seq) const {
+        for (cMessage *msg : held) {
+            if (msg->getKind() == seq && origin == msg->par("origin").stringValue()) {
+                return msg;
+            }
+        }
+        return nullptr;
+    }
+
+    size_t size() const {
+        return held.size();
+    }
+
+    // Pointers plus the message objects; their parameters are not counted
+    size_t bytes() const {
+        return memory::bytes(held) + held.size() * sizeof(cMessage);
+    }
+};
+
+// Per-origin gap detection over the sequence numbers received
+class GapTracker {
+  private:
+    std::map<std::string, int> highest;                     // Origin -> highest sequence number received
+    std::map<std::pair<std::string, int>, int> missing;     // (origin, seq) -> NACKs sent for it
+
+  public:
+    // Note a received copy, true if it closed a gap
+    bool received(const std::string &origin, int seq) {
+        auto it = highest.find(origin);
+        int top = it == highest.end() ? -1 : it->second;
+        if (seq > top) {
+            for (int skipped = top + 1; skipped < seq; ++skipped) {
+                missing[std::make_pair(origin, skipped)] = 0;
+            }
+            highest[origin] = seq;
+            return false;
+        }
+        return missing.erase(std::make_pair(origin, seq)) > 0;
+    }
+
+    // Gaps to NACK now, per origin. Gaps already NACKed maxTries times are
+    // given up and counted in givenUp.
+    std::map<std::string, std::vector<int>> due(int maxTries, long &givenUp) {
+        std::map<std::string, std::vector<int>> nacks;
+        for (auto it = missing.begin(); it != missing.end();) {
+            if (it->second >= maxTries) {
+                givenUp++;
+                it = missing.erase(it);
+                continue;
+            }
+            it->second++;
+            nacks[it->first.first].push_back(it->first.second);
+            ++it;
+        }
+        return nacks;
+    }
+
+    bool empty() const {
+        return missing.empty();
+    }
+
+    size_t size() const {
+        return missing.size();
+    }
+
+    size_t bytes() const {
+        return memory::bytes(highest) + memory::bytes(missing);
+    }
+
+    // Checkpoints keep the highest sequence numbers only: the broadcasts
+    // still missing cannot be repaired from the empty buffers of a new run
+    void save(std::ostream &out) const {
+        checkpoint::writeU32(out, highest.size());
+        for (const auto &entry : highest) {
+            checkpoint::writeString(out, entry.first);
+            checkpoint::writeU32(out, entry.second);
+        }
+    }
+
+    void load(std::istream &in) {
+        for (uint32_t n = checkpoint::readU32(in); n > 0; --n) {
+            std::string origin = checkpoint::readString(in);
+            highest[origin] = checkpoint::readU32(in);
+        }
+    }
+};
+
+} // namespace repair
+
+#endif